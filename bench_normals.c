@@ -0,0 +1,112 @@
+/*
+ * bench_normals.c - face normal throughput, in triangles per second
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stl_normals.h"
+
+#define N_TRI (4 * 1024 * 1024)
+#define ROUNDS 5
+
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void report(const char * what, double t)
+{
+    printf("+++ %-28s %8.1f Mtri/s\n", what, N_TRI * (double) ROUNDS / t / 1e6);
+}
+
+/* one triangle at a time on packed records, as the exporter used to */
+void naive(char * r, size_t n)
+{
+    size_t i;
+    for (i=0; i<n; i++, r+=STL_RECORD_SIZE) {
+        float v[9], nv[3];
+        memcpy(v, r + 12, 36);
+        float ux = v[3] - v[0], uy = v[4] - v[1], uz = v[5] - v[2];
+        float wx = v[6] - v[0], wy = v[7] - v[1], wz = v[8] - v[2];
+        nv[0] = uy * wz - uz * wy;
+        nv[1] = uz * wx - ux * wz;
+        nv[2] = ux * wy - uy * wx;
+        float len = sqrtf(nv[0] * nv[0] + nv[1] * nv[1] + nv[2] * nv[2]);
+        if (len > 0.0f) {
+            nv[0] /= len;
+            nv[1] /= len;
+            nv[2] /= len;
+        }
+        memcpy(r, nv, 12);
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct stl_soa_t t;
+    char * records;
+    double t0;
+    int i, k;
+
+    records = malloc((size_t) N_TRI * STL_RECORD_SIZE);
+    for (k=0; k<12; k++) {
+        float * a = malloc(N_TRI * sizeof(float));
+        if (!a || !records) {
+            printf("!!! out of memory\n");
+            return 1;
+        }
+        if (k < 9)
+            t.v[k] = a;
+        else
+            t.n[k - 9] = a;
+    }
+
+    srand(1);
+    for (i=0; i<N_TRI; i++) {
+        for (k=0; k<9; k++) {
+            t.v[k][i] = rand() / (float) RAND_MAX;
+            memcpy(records + (size_t) i * STL_RECORD_SIZE + 12 + 4 * k,
+                    &t.v[k][i], 4);
+        }
+    }
+
+    printf("+++ %d triangles, %d rounds, %s kernel, %d cpus\n",
+            N_TRI, ROUNDS, stl_normals_kernel(), nthreads);
+
+    t0 = now();
+    for (i=0; i<ROUNDS; i++)
+        naive(records, N_TRI);
+    report("packed, per triangle", now() - t0);
+
+    t0 = now();
+    for (i=0; i<ROUNDS; i++)
+        stl_soa_normals(&t, 0, N_TRI);
+    report("SoA kernel", now() - t0);
+
+    t0 = now();
+    for (i=0; i<ROUNDS; i++)
+        stl_face_normals(records, N_TRI, 1);
+    report("packed, 1 thread", now() - t0);
+
+    t0 = now();
+    for (i=0; i<ROUNDS; i++)
+        stl_face_normals(records, N_TRI, nthreads);
+    report("packed, all threads", now() - t0);
+
+    return 0;
+}
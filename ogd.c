@@ -0,0 +1,128 @@
+/*
+ * ogd.c - read the object index of ogldump capture containers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "ogd.h"
+
+/* a container without index, walk the STLs one by one */
+static int ogd_scan(FILE * f, const char * fname, struct ogd_object_t ** objs)
+{
+    uint64_t off = sizeof(struct ogd_header_t);
+    uint32_t n_tri;
+    int n = 0, size = 0;
+
+    printf("+++ %s has no index, scanning it\n", fname);
+    for (;;) {
+        if (fseeko(f, off + 80, SEEK_SET) || fread(&n_tri, 4, 1, f) != 1)
+            break;
+        if (n == size) {
+            size = size ? 2 * size : 64;
+            *objs = realloc(*objs, size * sizeof(**objs));
+            if (!*objs) {
+                printf("!!! couldn't realloc object list: %s\n", strerror(errno));
+                return -1;
+            }
+        }
+        memset(&(*objs)[n], 0, sizeof(**objs));
+        snprintf((*objs)[n].name, OGD_NAME_LEN, "object_%07d", n);
+        (*objs)[n].offset      = off;
+        (*objs)[n].n_triangles = n_tri;
+        n++;
+        off += 84 + 50 * (uint64_t) n_tri;
+    }
+    return n;
+}
+
+static int ogd_index(FILE * f, const char * fname, struct ogd_object_t ** objs)
+{
+    struct ogd_header_t h;
+
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, OGD_MAGIC, 8)) {
+        /* a plain STL */
+        *objs = calloc(1, sizeof(**objs));
+        if (!*objs) {
+            printf("!!! couldn't calloc object list: %s\n", strerror(errno));
+            return -1;
+        }
+        if (fseeko(f, 80, SEEK_SET) || fread(&(*objs)->n_triangles, 4, 1, f) != 1) {
+            printf("!!! couldn't read the triangle count of %s\n", fname);
+            return -1;
+        }
+        return 1;
+    }
+    if (h.version != OGD_VERSION) {
+        printf("!!! %s is container version %u, expected %u\n",
+                fname, h.version, OGD_VERSION);
+        return -1;
+    }
+    if (!h.index_offset)
+        return ogd_scan(f, fname, objs);
+    if (!h.n_objects)
+        return 0;
+
+    *objs = malloc(h.n_objects * sizeof(**objs));
+    if (!*objs) {
+        printf("!!! couldn't malloc index of %u objects: %s\n",
+                h.n_objects, strerror(errno));
+        return -1;
+    }
+    if (fseeko(f, h.index_offset, SEEK_SET) ||
+            fread(*objs, sizeof(**objs), h.n_objects, f) != h.n_objects) {
+        printf("!!! couldn't read the index of %s\n", fname);
+        return -1;
+    }
+    return h.n_objects;
+}
+
+int ogd_objects(const char * spec, char ** fname, struct ogd_object_t ** objs)
+{
+    const char * name = NULL;
+    char * colon;
+    FILE * f;
+    int n, i;
+
+    *fname = strdup(spec);
+    *objs  = NULL;
+    if (!*fname) {
+        printf("!!! couldn't strdup: %s\n", strerror(errno));
+        return -1;
+    }
+    /* file:object, unless the whole spec names a file */
+    colon = strrchr(*fname, ':');
+    if (colon && access(*fname, F_OK)) {
+        *colon = 0;
+        name   = colon + 1;
+    }
+
+    f = fopen(*fname, "r");
+    if (!f) {
+        printf("!!! couldn't fopen(%s): %s\n", *fname, strerror(errno));
+        return -1;
+    }
+    n = ogd_index(f, *fname, objs);
+    fclose(f);
+
+    if (n < 0 || !name)
+        return n;
+    for (i=0; i<n; i++) {
+        if (!strcmp((*objs)[i].name, name)) {
+            (*objs)[0] = (*objs)[i];
+            return 1;
+        }
+    }
+    printf("!!! %s has no object %s\n", *fname, name);
+    return -1;
+}
@@ -0,0 +1,49 @@
+/*
+ * ogd.h - ogldump capture containers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#ifndef OGD_H
+#define OGD_H
+
+#include <stdint.h>
+
+/* a container holds many objects, each one a complete binary STL: */
+/*   struct ogd_header_t                                           */
+/*   the objects, one STL after the other                          */
+/*   n_objects struct ogd_object_t at index_offset                 */
+/* the index is written when the container is closed. without it   */
+/* (the application died) the objects are found by walking the STLs */
+
+#define OGD_MAGIC    "OGLDUMP" /* 8 bytes with the 0 */
+#define OGD_VERSION  1
+#define OGD_SUFFIX   ".ogd"
+#define OGD_NAME_LEN 32
+
+struct ogd_header_t {
+    char     magic[8];
+    uint32_t version;
+    uint32_t n_objects;
+    uint64_t index_offset; /* 0 until the container is closed */
+};
+
+struct ogd_object_t {
+    char     name[OGD_NAME_LEN]; /* e.g. prim_0000042, 0 terminated */
+    uint64_t offset;             /* of the object's STL header */
+    uint32_t n_triangles;
+    uint32_t frame;
+};
+
+/* the objects named by spec: all of a container, or just the one */
+/* after a ':' as in capture_00000.ogd:prim_0000042. a plain STL   */
+/* file is one object at offset 0 with an empty name. *fname is    */
+/* the file to open.                                               */
+/* returns the number of objects in *objs, which is to be free()d, */
+/* or -1 after printing what's wrong.                              */
+int ogd_objects(const char * spec, char ** fname, struct ogd_object_t ** objs);
+
+#endif
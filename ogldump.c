@@ -15,24 +15,75 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <dlfcn.h>
 #include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <time.h>
+#include <math.h>
+#include <zlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 
 #include <GL/gl.h>
 #include <GL/glx.h>
 
-#define DUMP_COUNT_DEFAULT 50000
-uint32_t DUMP_COUNT = DUMP_COUNT_DEFAULT;
-uint32_t dump_count = 0;
-
-#define VERBOSE
+#include "stl_normals.h"
+#include "ogd.h"
+#include "ogr.h"
+
+/* capture state, see the capture triggers section */
+#define CAPTURE_FRAMES  1 /* a triggered capture is running */
+#define CAPTURE_LIST    2 /* added for every display list being compiled */
+#define CAPTURE_INIT    4 /* until init() ran, see dump_on() */
+int      capturing      = CAPTURE_INIT; /* the one word the recording wrappers test */
+uint32_t capture_frames = 1; /* frames per trigger, OGLDUMP_FRAMES */
+uint32_t frames_request = 0; /* set by a trigger, taken by the next swap */
+uint32_t frames_left    = 0;
+uint32_t nFrames        = 0; /* frames captured so far */
+uint32_t nCaptures      = 0; /* triggers so far */
+uint32_t dump_count     = 0; /* objects per capture, OGLDUMP_DUMP_COUNT */
+uint32_t objects_left   = 0;
+uint32_t ring_frames    = 0; /* flight recorder, OGLDUMP_RING */
+size_t   ring_size      = 64 << 20; /* per context, OGLDUMP_RING_SIZE */
+uint32_t ring_contexts  = 4; /* contexts with a ring, OGLDUMP_RING_CONTEXTS */
+size_t   ring_frame_max = 0; /* ring_size shared by the frames */
+uint32_t ring_dropped   = 0; /* objects over ring_frame_max */
+uint32_t ring_lost      = 0; /* frames given up while the exporter was behind */
+
+/* trace levels, selected with OGLDUMP_TRACE */
+#define TRACE_OFF   0
+#define TRACE_PRIMS 1 /* glBegin(), glDrawElements(), pointers, ... */
+#define TRACE_CALLS 2 /* every wrapped call, vertices and normals too */
+
+/* build with -DNO_VERBOSE to compile tracing out completely */
+#ifndef NO_VERBOSE
+#  define VERBOSE
+#endif
 #ifdef VERBOSE
-#  define verbprintf printf
+extern int trace_level;
+void trace_rec(const char * fmt, ...);
+#  define verbprintf(lvl, ...) \
+    do { \
+        if (__builtin_expect(trace_level >= (lvl), 0)) \
+            trace_rec(__VA_ARGS__); \
+    } while (0)
 #else
-#  define verbprintf(x,...)
+#  define verbprintf(lvl, ...)
 #endif
 
 #define FNAME_PREFIX_DEFAULT "/var/tmp/ogldump_data"
@@ -59,6 +110,17 @@ char * prim_type_name[0x0a] = {
     "GL_POLYGON"
 };
 
+/* modes past GL_POLYGON, like GL_TRIANGLES_ADJACENCY, are "?" */
+static inline const char * prim_name(GLenum mode)
+{
+    return mode < 0x0a ? prim_type_name[mode] : "?";
+}
+
+int gl_mode_has_triangles(GLenum mode)
+{
+    return mode >= GL_TRIANGLES && mode <= GL_POLYGON;
+}
+
 struct vertex_t {
     float x;
     float y;
@@ -80,38 +142,40 @@ struct triangle_t {
     float z3;
 };
 
-int nNorm = 0;
-struct N3_t {
-    struct N3_t   * next;
-
-    struct vertex_t v;
-} * norm_last, * norm;
-
-struct V3_t {
-    struct V3_t   * next;
-    struct N3_t   * norm;
-
-    struct vertex_t v;
+/* captured vertices and their normals, packed as x,y,z floats. */
+/* prims refer to a range [first, first+nV3) of these arrays.   */
+struct vstore_t {
+    float    * v;
+    float    * n;
+    uint32_t   count;
+    uint32_t   size;
 };
 
+/* a client array as set by glVertexPointer(), glNormalPointer(), ... */
 struct vertexpointer_t {
-    struct vertexpointer_t  * next;
+    int                     enabled; /* by glEnableClientState() */
 
-    /* arguments from glVertexPointer() */
+    /* arguments from gl*Pointer() */
     GLint                   size;
     GLenum                  type;
     GLsizei                 stride;
-    const GLvoid          * ptr;
+    const GLvoid          * ptr;    /* an offset if buffer is set */
+    struct buffer_t       * buffer; /* GL_ARRAY_BUFFER bound at the time */
 
-    void                  * ptr_copy;
+    void                  * ptr_copy; /* vertices min_index to max_index */
     int                     sizeof_type;
+    uint32_t                min_index;
     uint32_t                max_index;
-    struct triangle_t     * tri;
-} * vertexpointer, * all_vertexpointer;
+};
 
+/* one glDrawElements(), glDrawArrays() or the like. for the latter */
+/* indices is NULL and the vertices min_index to max_index are used */
 int nDrawElements = 0;
 struct drawelements_t {
     struct drawelements_t  * next;
+    int                      n; /* number of the DrawElements, for its file */
+    uint32_t                 frame;   /* nFrames when it was recorded */
+    uint32_t                 capture; /* number of the trigger, from 0 */
 
     GLenum                   mode;
     GLsizei                  count;
@@ -119,17 +183,42 @@ struct drawelements_t {
     GLvoid                 * indices;
 
     int                      sizeof_type;
-    struct N3_t            * norm;
-    struct vertexpointer_t * vertexpointer;
-} * drawelements, * all_drawelements;
+    const float            * modelview; /* NULL for the identity */
+    int                      absolute;  /* see dlist_t */
+    struct vertexpointer_t   vertexpointer;
+    /* the other arrays, over the same vertex range. size is 0 */
+    /* for those that weren't enabled.                          */
+    struct vertexpointer_t   normalpointer;
+    struct vertexpointer_t   texcoordpointer;
+    struct vertexpointer_t   colorpointer;
+};
+
+/* one glCallList() of a list that draws something. the list is */
+/* kept until the capture is released, it's exported as one     */
+/* object per call, in the place of the call.                   */
+int nListCalls = 0;
+struct listcall_t {
+    struct listcall_t * next;
+    int                 n;       /* number of the call, for its file */
+    uint32_t            frame;   /* as in drawelements_t */
+    uint32_t            capture;
+    struct dlist_t    * list;
+    const float       * modelview; /* NULL for the identity */
+    int                 absolute;  /* see dlist_t */
+};
 
 int nPrim = 0;
 struct prim_t {
     struct prim_t * next;
+    int              n;     /* number of the prim, for its file */
+    uint32_t         frame;   /* as in drawelements_t */
+    uint32_t         capture;
     int              nV3;
-    struct V3_t    * V3;
+    uint32_t         first; /* index of the 1st vertex in vstore */
     int              type; /* one of the primitives GL_POINTS, GL_LINES, ... */
-} * all_prims;
+    const float    * modelview; /* NULL for the identity */
+    int              absolute;  /* see dlist_t */
+};
 
 void enomem(void)
 {
@@ -137,725 +226,5333 @@ void enomem(void)
     exit(1);
 }
 
-struct prim_t * current_prim = NULL;
-struct prim_t * new_prim(GLenum type)
-{
-    struct prim_t * p = all_prims;
-    if (!p) {
-        p = malloc(sizeof(*p));
-        all_prims = p;
-    } else {
-        while(p->next)
-            p = p->next;
-        p->next = malloc(sizeof(*p));
-        p = p->next;
-    }
-    if (!p) enomem();
-    p->next = NULL;
-    p->nV3  = 0;
-    p->V3   = NULL;
-    p->type = type;
-    nPrim++;
-    return p;
-}
+/**************************************************************/
+/* capture arena                                              */
+/* all recording structures are bump-allocated from large     */
+/* chunks and released in one go once the capture is flushed */
+
+#define ARENA_CHUNK_DEFAULT (4 * 1024 * 1024)
+#define ARENA_ALIGN 16
+
+struct arena_chunk_t {
+    struct arena_chunk_t * next;
+    size_t                 size;
+    size_t                 used;
+    char                 * data;
+};
 
-void new_V3(
-        float x,
-        float y,
-        float z)
+struct arena_t {
+    struct arena_chunk_t * chunk;      /* current chunk, head of the list */
+    struct arena_chunk_t * spare;      /* kept by arena_reset() for reuse */
+    size_t                 chunk_size; /* size of a regular chunk */
+    size_t                 in_use;     /* bytes handed out */
+    size_t                 reserved;   /* bytes malloc()ed from the system */
+    size_t                 high_water; /* max of in_use ever seen */
+    int                    nchunks;
+    int                    fixed;      /* never grows, see ring_capture_new() */
+};
+
+size_t arena_chunk_size = ARENA_CHUNK_DEFAULT;
+size_t arena_high_water = 0; /* over all captures */
+size_t dedup_saved      = 0; /* bytes not copied thanks to capture_copy() */
+
+struct arena_chunk_t * arena_new_chunk(struct arena_t * a, size_t size)
 {
-    if (!current_prim) {
-        printf("!!! ignoring V3 outside of prim\n");
-        return;
-    }
-    struct prim_t * p = current_prim;
-    struct V3_t * v = p->V3;
-    if (!v) {
-        v = malloc(sizeof(*v));
-        p->V3 = v;
-    } else {
-        while (v->next)
-            v = v->next;
-        v->next = malloc(sizeof(*v));
-        v = v->next;
+    struct arena_chunk_t * c = a->spare;
+
+    if (c && size == a->chunk_size) {
+        a->spare = c->next;
+        c->next  = NULL;
+        c->used  = 0;
+        return c;
     }
-    if (!v) enomem();
-    v->next = NULL;
-    v->norm = norm_last;
-    v->v.x = x;
-    v->v.y = y;
-    v->v.z = z;
-    p->nV3++;
+    c = malloc(sizeof(*c) + size + ARENA_ALIGN);
+    if (!c) enomem();
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    c->data = (char *)(((uintptr_t)(c + 1) + ARENA_ALIGN - 1)
+              & ~(uintptr_t)(ARENA_ALIGN - 1));
+
+    a->reserved += size;
+    a->nchunks++;
+    return c;
 }
 
-void new_N3(
-        float x,
-        float y,
-        float z)
+void arena_init(struct arena_t * a, size_t chunk_size)
 {
-    struct N3_t * p = norm_last;
-    if (!p) {
-        p = malloc(sizeof(*p));
-        norm = p;
-    } else {
-        p->next = malloc(sizeof(*p));
-        p = p->next;
-    }
-    if (!p) enomem();
-    p->next = NULL;
-    p->v.x = x;
-    p->v.y = y;
-    p->v.z = z;
-    norm_last = p;
+    memset(a, 0, sizeof(*a));
+    a->chunk_size = chunk_size;
+    a->chunk      = arena_new_chunk(a, chunk_size);
 }
 
-void copy_vertexpointer(void)
+void * arena_alloc(struct arena_t * a, size_t size)
 {
-    struct vertexpointer_t * v = vertexpointer;
-
-    if (!v)
-        return;
-    if (!v->max_index)
-        return;
-    if (!v->ptr)
-        return;
+    struct arena_chunk_t * c = a->chunk;
+    void * ret;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (!c || c->used + size > c->size) {
+        if (a->fixed)
+            return NULL; /* the caller drops what doesn't fit */
+        if (size > a->chunk_size / 4) {
+            /* large blobs get a chunk of their own, queued behind   */
+            /* the current one, so its free space is not thrown away */
+            struct arena_chunk_t * big = arena_new_chunk(a, size);
+            big->used = size;
+            if (c) {
+                big->next = c->next;
+                c->next   = big;
+            } else {
+                a->chunk  = big;
+            }
+            a->in_use += size;
+            if (a->in_use > a->high_water)
+                a->high_water = a->in_use;
+            return big->data;
+        }
+        c = arena_new_chunk(a, a->chunk_size);
+        c->next  = a->chunk;
+        a->chunk = c;
+    }
 
-    v->ptr_copy = malloc((v->max_index + 1) * v->stride);
-    if (!v->ptr_copy)
-        enomem();
-    memcpy(v->ptr_copy, v->ptr, (v->max_index + 1) * v->stride);
+    ret = c->data + c->used;
+    c->used   += size;
+    a->in_use += size;
+    if (a->in_use > a->high_water)
+        a->high_water = a->in_use;
+    return ret;
 }
 
-void set_max_index_DrawElements(struct drawelements_t * p)
+/* empty the arena but keep its regular chunks for the next  */
+/* allocations, only chunks of large blobs go back to malloc */
+void arena_reset(struct arena_t * a)
 {
-    int i;
-    for (i=0; i<p->count; i++) {
-        uint16_t * s16 = p->indices;
-        uint32_t * s32 = p->indices;
-        switch (p->type){
-            case GL_UNSIGNED_SHORT:
-                if (s16[i] > p->vertexpointer->max_index)
-                {
-                    p->vertexpointer->max_index = s16[i];
-                    //				printf("new_max: %d\n", p->vertexpointer->max_index);
-                }
-                break;
-            case GL_UNSIGNED_INT:
-                if (s32[i] > p->vertexpointer->max_index)
-                {
-                    p->vertexpointer->max_index = s32[i];
-                    //				printf("new_max: %d\n", p->vertexpointer->max_index);
-                }
-                break;
-            default:
-                printf("!!! FIXME: support DrawElements() type 0x%4.4x\n",
-                        p->type);
+    struct arena_chunk_t * c = a->chunk;
+    while (c) {
+        struct arena_chunk_t * next = c->next;
+        if (c->size == a->chunk_size) {
+            c->next  = a->spare;
+            a->spare = c;
+        } else {
+            a->reserved -= c->size;
+            a->nchunks--;
+            free(c);
         }
-
+        c = next;
     }
+    a->chunk  = arena_new_chunk(a, a->chunk_size);
+    a->in_use = 0;
 }
 
-void dump_de()
+/* hand all memory back at once, the high water mark is kept */
+void arena_release(struct arena_t * a)
 {
-    struct drawelements_t * p = drawelements;
-
-    uint32_t * ind = p->indices;
-    int i;
-    printf("drawelements type 0x%4.4x, mode 0x%4.4x, sizeof_type %d\n",
-            p->type, p->mode, p->sizeof_type);
-    printf("indices:\n");
-    for (i=0; i<p->count; i++){
-        printf("%8.8x ", ind[i]);
-        if ((i%8)==7)
-            printf("\n");
+    struct arena_chunk_t * c = a->chunk;
+    while (c) {
+        struct arena_chunk_t * next = c->next;
+        free(c);
+        c = next;
     }
-    printf("\n");
-    struct vertexpointer_t * vp = p->vertexpointer;
-    printf("vertexpointer size %d, type 0x%4.4x, stride %d, sizeof_type %d, max_index 0x%8.8x\n",
-            vp->size, vp->type, vp->stride, vp->sizeof_type, vp->max_index);
-    printf("\n");
-    printf("\n");
-    return;
-    float * f = vp->ptr_copy;
-    for (i=0; i<p->count; i++){
-        printf("%2.3e ", f[ind[i]]);
-        if ((i%8)==7)
-            printf("\n");
+    for (c = a->spare; c; ) {
+        struct arena_chunk_t * next = c->next;
+        free(c);
+        c = next;
     }
+    a->chunk    = NULL;
+    a->spare    = NULL;
+    a->in_use   = 0;
+    a->reserved = 0;
+    a->nchunks  = 0;
 }
 
+void vstore_grow(struct vstore_t * s)
+{
+    uint32_t size = s->size ? 2 * s->size : 64 * 1024;
+    float * v = realloc(s->v, size * 3 * sizeof(float));
+    if (!v) enomem();
+    s->v = v;
+    float * n = realloc(s->n, size * 3 * sizeof(float));
+    if (!n) enomem();
+    s->n = n;
+    s->size = size;
+}
 
-void new_DrawElements( GLenum mode, GLsizei count,
-        GLenum type, const GLvoid *indices )
+/* room for exactly size vertices, for stores that must not grow */
+void vstore_reserve(struct vstore_t * s, uint32_t size)
 {
+    s->v = malloc(size * 3 * sizeof(float));
+    s->n = malloc(size * 3 * sizeof(float));
+    if (!s->v || !s->n) enomem();
+    s->size = size;
+}
 
-    if (!indices) return;
-    if (indices < (void *)0x08000000) return; /* fuckyou, OpenGL, FUCK FUCK FUCK you, fuck YOU! */
+void vstore_release(struct vstore_t * s)
+{
+    free(s->v);
+    free(s->n);
+    memset(s, 0, sizeof(*s));
+}
 
-    if (mode != GL_TRIANGLES) {
-        printf("!!! FIXME: support DrawElements(mode %s / 0x%4.4x)\n",
-                prim_type_name[mode], mode);
-        return;
-    }
+/**************************************************************/
+/* a capture holds everything recorded between two hand-offs  */
+/* to the exporter. it owns all of its memory, so it can be   */
+/* written and released while recording goes on in a new one  */
+
+struct capture_t {
+    struct arena_t          arena;
+    struct vstore_t         vstore;
+    struct prim_t         * all_prims;
+    struct prim_t         * last_prim;
+    struct drawelements_t * all_drawelements;
+    struct drawelements_t * last_drawelements;
+    struct listcall_t     * all_listcalls;
+    struct listcall_t     * last_listcall;
+    int                     nPrim;
+    int                     nDrawElements;
+    int                     nListCalls;
+    struct blob_t        ** blobs;     /* BLOB_BUCKETS hash chains */
+    size_t                  dedup_saved;
+    struct ring_t         * owner;     /* whose flight recorder pool it's in */
+    struct capture_t      * next_free; /* in that pool */
+};
 
-    if ( (type != GL_UNSIGNED_SHORT) && (type != GL_UNSIGNED_INT) ) {
-        printf("!!! FIXME: support DrawElements() type 0x%4.4x\n", type);
-        return;
-    }
+struct capture_t * capture_alloc(size_t chunk_size)
+{
+    struct capture_t * c = calloc(1, sizeof(*c));
+    if (!c) enomem();
+    arena_init(&c->arena, chunk_size);
+    return c;
+}
 
-    struct drawelements_t * p = drawelements;
-    struct drawelements_t * p_prev = NULL;
-    if (!p) {
-        p = malloc(sizeof(*p));
-        all_drawelements = p;
-    } else {
-        p->next = malloc(sizeof(*p));
-        p_prev = p;
-        p = p->next;
-    }
-    if (!p) enomem();
-    p->next = NULL;
-    p->norm = norm_last;
+struct capture_t * capture_new(void)
+{
+    return capture_alloc(arena_chunk_size);
+}
 
-    p->mode  = mode;
-    p->count = count;
-    p->type  = type;
+void dlist_put(struct dlist_t * l);
 
-    p->vertexpointer = vertexpointer;
+/* empty c for the next recording, its memory is kept */
+void capture_reset(struct capture_t * c)
+{
+    struct listcall_t * l;
+
+    for (l = c->all_listcalls; l; l = l->next)
+        dlist_put(l->list);
+    if (c->arena.high_water > arena_high_water)
+        arena_high_water = c->arena.high_water;
+    __atomic_fetch_add(&dedup_saved, c->dedup_saved, __ATOMIC_RELAXED);
+    arena_reset(&c->arena);
+    c->vstore.count      = 0;
+    c->all_prims         = NULL;
+    c->last_prim         = NULL;
+    c->all_drawelements  = NULL;
+    c->last_drawelements = NULL;
+    c->all_listcalls     = NULL;
+    c->last_listcall     = NULL;
+    c->nPrim             = 0;
+    c->nDrawElements     = 0;
+    c->nListCalls        = 0;
+    c->blobs             = NULL;
+    c->dedup_saved       = 0;
+}
 
-    switch (mode) {
-        case GL_TRIANGLES:
-            {
-                int sizeof_type = 0;
-                switch (type) {
-                    case GL_UNSIGNED_BYTE:
-                        sizeof_type = 1;
-                        break;
-                    case GL_UNSIGNED_SHORT:
-                        sizeof_type = 2;
-                        break;
-                    case GL_UNSIGNED_INT:
-                        sizeof_type = 4;
-                        break;
-                    default:
-                        printf("!!! ERROR: glDrawElements() wit unknown type 0x%x\n",
-                                type);
-                        exit(1);
-                }
-                p->sizeof_type = sizeof_type;
-                p->indices = malloc( sizeof_type * count );
-                if (!p->indices) enomem();
-                memcpy(p->indices, indices, sizeof_type * count );
+void capture_release(struct capture_t * c)
+{
+    capture_reset(c);
+    arena_release(&c->arena);
+    vstore_release(&c->vstore);
+    free(c);
+}
 
-                set_max_index_DrawElements(p);
+/* rough memory footprint, to decide when to hand a capture off */
+size_t capture_size(struct capture_t * c)
+{
+    return c->arena.in_use + c->vstore.count * 6 * sizeof(float);
+}
 
-                break;
-            }
-        default:
-            printf("!!! FIXME: support DrawElements(%s / 0x%4.4x)\n",
-                    prim_type_name[mode], mode);
-            free(p);
-            if (p_prev) {
-                p_prev->next = NULL;
-            } else {
-                all_drawelements = NULL;
-            }
-            p = NULL;
-            return;
-    }
+/**************************************************************/
+/* vertex and index arrays copied into a capture are kept by  */
+/* content, so a mesh drawn many times is stored only once.   */
+/* the copies are shared and must not be written to. the data */
+/* follows its blob_t, so blob_of() finds it from a copy.      */
 
-    copy_vertexpointer();
-    nDrawElements++;
-    drawelements = p;
-    //	dump_de();
-}
+#define BLOB_BUCKETS 4096 /* must be a power of 2 */
 
-void new_VertexPointer( GLint size, GLenum type,
-        GLsizei stride, const GLvoid *ptr )
-{
-    if (size != 3) {
-        printf("!!! unsupported new_VertexPointer() size %d\n", size);
-        return;
-    }
-    if ( (type != GL_FLOAT) &&
-            (type != GL_SHORT) )
-    {
-        printf("!!! unsupported new_VertexPointer() type %d\n", type);
-        return;
-    }
+struct blob_t {
+    struct blob_t * next;
+    uint64_t        hash;
+    size_t          len;
+};
 
-    struct vertexpointer_t * p = vertexpointer;
+#define blob_data(b) ((void *)((b) + 1))
+#define blob_of(p)   ((struct blob_t *)(p) - 1)
 
-    if (!p) {
-        p = malloc(sizeof(*p));
-        all_vertexpointer = p;
-    } else {
-        p->next = malloc(sizeof(*p));
-        p = p->next;
+uint64_t hash_bytes(const void * data, size_t len)
+{
+    const unsigned char * p = data;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    uint64_t k;
+
+    for (; len >= 8; len -= 8, p += 8) {
+        memcpy(&k, p, 8);
+        h ^= k * 0xff51afd7ed558ccdULL;
+        h  = ((h << 31) | (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
     }
-    if (!p) enomem();
-    p->next = NULL;
-
-    p->size   = size;
-    p->type   = type;
-    p->ptr    = ptr;
-    p->stride = stride;
+    k = 0;
+    memcpy(&k, p, len);
+    h ^= k * 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
 
-    p->max_index = 0;
+/* returns a copy of src owned by the capture, or NULL if it */
+/* doesn't fit a capture of the flight recorder               */
+void * capture_copy(struct capture_t * c, const void * src, size_t len)
+{
+    uint64_t hash = hash_bytes(src, len);
+    struct blob_t * b;
+
+    if (!c->blobs) {
+        c->blobs = arena_alloc(&c->arena, BLOB_BUCKETS * sizeof(*c->blobs));
+        if (!c->blobs) {
+            __atomic_fetch_add(&ring_dropped, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        memset(c->blobs, 0, BLOB_BUCKETS * sizeof(*c->blobs));
+    }
 
-    p->sizeof_type = 0;
-    switch (type) {
-        case GL_SHORT:
-            p->sizeof_type = 2;
-            break;
-        case GL_INT:
-            p->sizeof_type = 4;
-            break;
-        case GL_FLOAT:
-            p->sizeof_type = 4;
-            break;
-        case GL_DOUBLE:
-            p->sizeof_type = 8;
-            break;
-        default:
-            printf("!!! ERROR: unknown type %d in glVertexPointer()\n", type);
-            exit(1);
+    struct blob_t ** head = &c->blobs[hash & (BLOB_BUCKETS - 1)];
+    for (b = *head; b; b = b->next) {
+        if (b->hash == hash && b->len == len && !memcmp(blob_data(b), src, len)) {
+            c->dedup_saved += len;
+            return blob_data(b);
+        }
     }
 
-    vertexpointer = p;
-    /* a stride of 0 means tightly packed, we prefer a correct stride value */
-    if (p->stride == 0){
-        p->stride = p->sizeof_type * p->size;
+    b = arena_alloc(&c->arena, sizeof(*b) + len);
+    if (!b) {
+        __atomic_fetch_add(&ring_dropped, 1, __ATOMIC_RELAXED);
+        return NULL;
     }
+    b->hash = hash;
+    b->len  = len;
+    memcpy(blob_data(b), src, len);
+    b->next = *head;
+    *head   = b;
+    return blob_data(b);
 }
 
 /**************************************************************/
-/* processing opengl primitives to STL normals and triangles */
-
-int n_stl_triangles = 0;
-void emit_stl_triangle(FILE * f, struct triangle_t t)
-{
-    n_stl_triangles++;
-
-    fwrite(&t.xn, 4, 1, f);
-    fwrite(&t.yn, 4, 1, f);
-    fwrite(&t.zn, 4, 1, f);
+/* buffer objects                                             */
+/* the contents of all buffer objects are shadowed in host    */
+/* memory, so draws sourcing vertices or indices from a bound */
+/* buffer can be copied just like client arrays               */
+
+struct buffer_t {
+    GLuint   name;
+    size_t   size;
+    char   * data;
+    char   * map;        /* the app's pointer while mapped for writing */
+    size_t   map_offset;
+    size_t   map_length;
+};
 
-    fwrite(&t.x1, 4, 1, f);
-    fwrite(&t.y1, 4, 1, f);
-    fwrite(&t.z1, 4, 1, f);
-    fwrite(&t.x2, 4, 1, f);
-    fwrite(&t.y2, 4, 1, f);
-    fwrite(&t.z2, 4, 1, f);
-    fwrite(&t.x3, 4, 1, f);
-    fwrite(&t.y3, 4, 1, f);
-    fwrite(&t.z3, 4, 1, f);
+/* buffers[] is indexed by name. draws go through the recorder's */
+/* bindings, the lock guards the shadows while they're copied.    */
+pthread_mutex_t    buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+struct buffer_t ** buffers      = NULL;
+GLuint             nbuffers     = 0;
 
-    uint16_t unused = 0;
-    fwrite(&unused, 1, 2, f);
+/* called with buffers_lock held */
+struct buffer_t * buffer_get(GLuint name)
+{
+    if (name >= nbuffers) {
+        GLuint n = nbuffers ? nbuffers : 256;
+        while (n <= name)
+            n *= 2;
+        struct buffer_t ** b = realloc(buffers, n * sizeof(*b));
+        if (!b) enomem();
+        memset(b + nbuffers, 0, (n - nbuffers) * sizeof(*b));
+        buffers  = b;
+        nbuffers = n;
+    }
+    if (!buffers[name]) {
+        buffers[name] = calloc(1, sizeof(struct buffer_t));
+        if (!buffers[name]) enomem();
+        buffers[name]->name = name;
+    }
+    return buffers[name];
 }
 
-void fixup_stl(FILE * f, int n_triangles)
+/* 4x4 matrices, column-major as in GL */
+
+void mat_identity(float * m)
 {
-    fseek(f, 80, SEEK_SET);
-    fwrite(&n_triangles, 1, 4, f);
-    n_stl_triangles = 0;
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = m[5] = m[10] = m[15] = 1.0f;
 }
 
-/* consume N gl vertices, emit N/2 triangles */
-/* N needs to be a factor of 4 */
-void do_gl_quads(FILE * f, struct prim_t * prim)
+/* m = m * b */
+void mat_mul(float * m, const float * b)
 {
-    if (!prim) return;
+    float a[16];
+    int i, j;
+
+    memcpy(a, m, sizeof(a));
+    for (j=0; j<4; j++)
+        for (i=0; i<4; i++)
+            m[4*j + i] = a[i]      * b[4*j]     + a[4 + i]  * b[4*j + 1] +
+                         a[8 + i]  * b[4*j + 2] + a[12 + i] * b[4*j + 3];
+}
 
-    struct V3_t * p = prim->V3;
-    int i;
+/**************************************************************/
+/* per thread recording                                       */
+/* GL state such as array pointers and the modelview stack    */
+/* belongs to a GLX context, which may be made current on any */
+/* thread. it is shadowed in a context_t. what is recorded    */
+/* goes to the capture of the thread drawing, its recorder_t, */
+/* so draw calls never take a lock. both are never freed and  */
+/* are found through append-only lists.                       */
+
+#define MODELVIEW_STACK_DEPTH 32 /* what GL guarantees */
+
+struct context_t {
+    struct context_t      * next;
+    GLXContext              ctx;           /* NULL for a thread's own */
+    struct vertex_t         norm_cur;      /* as set by glNormal*() */
+    struct vertexpointer_t  vertexpointer; /* size is 0 while unset */
+    struct vertexpointer_t  normalpointer;
+    struct vertexpointer_t  texcoordpointer; /* of texture unit 0 */
+    struct vertexpointer_t  colorpointer;
+    struct buffer_t       * array_buffer;   /* bound buffer objects */
+    struct buffer_t       * element_buffer;
+
+    GLenum                  matrix_mode;
+    float                   modelview[MODELVIEW_STACK_DEPTH][16];
+    int                     modelview_depth; /* index of the top */
+    uint32_t                modelview_gen;   /* bumped on every change */
+    GLuint                  list_base;  /* as set by glListBase() */
+
+    struct ring_t         * ring;      /* see ring_attach() */
+    int                     ring_none; /* none was left for it */
+};
 
-    struct vertex_t   v[4];
-    struct triangle_t t;
+struct recorder_t {
+    struct recorder_t     * next;
+    struct context_t      * gl;  /* current, NULL between contexts */
+    struct context_t      * own; /* for drawing without a context */
+    struct capture_t      * cap;
+    struct prim_t         * current_prim;
+    int                     prim_dropped;  /* glBegin() over the budget */
+
+    const float           * modelview_snapshot; /* see modelview_snapshot() */
+    struct capture_t      * modelview_snapshot_cap;
+    struct context_t      * modelview_snapshot_gl;
+    uint32_t                modelview_snapshot_gen;
+    int                     modelview_snapshot_identity;
+
+    struct dlist_t        * list;       /* being compiled, see dlist_new() */
+    struct context_t      * list_gl;    /* the context it is compiled in */
+    struct capture_t      * saved_cap;  /* state to go back to at glEndList() */
+    GLenum                  saved_matrix_mode;
+    int                     saved_depth;
+    float                   saved_modelview[MODELVIEW_STACK_DEPTH][16];
+    uint32_t                list_absolute; /* stack levels it loaded */
+    uint32_t                dlist_seq; /* odd in dlist_call(), see dlist_quiesce() */
+};
 
-    while (p) {
+struct recorder_t * all_recorders = NULL;
+struct context_t  * all_contexts  = NULL;
+pthread_mutex_t     contexts_lock = PTHREAD_MUTEX_INITIALIZER;
 
-        t.xn = p->norm->v.x;
-        t.yn = p->norm->v.y;
-        t.zn = p->norm->v.z;
+void ring_switch(struct recorder_t * r, struct context_t * g);
+int  ring_attach(struct recorder_t * r);
+void init(void);
 
-        for (i=0; i<4; i++) {
+static __thread struct recorder_t * rec
+    __attribute__((tls_model("initial-exec"))) = NULL;
+pthread_key_t recorder_key; /* for ring_thread_exit() */
 
-            if (!p) {
-                printf("!!! ERROR do_gl_quads()\n");
-                exit(1); /* FIXME: be more gracefully */
-            }
+struct context_t * context_new(GLXContext ctx)
+{
+    struct context_t * g = calloc(1, sizeof(*g));
+    if (!g) enomem();
+    g->ctx         = ctx;
+    g->norm_cur.z  = 1.0; /* an initial default normal */
+    g->matrix_mode = GL_MODELVIEW;
+    mat_identity(g->modelview[0]);
+    return g;
+}
 
-            v[i].x = p->v.x;
-            v[i].y = p->v.y;
-            v[i].z = p->v.z;
+/* the shadow state of a GLX context, whichever thread made it */
+struct context_t * context_get(GLXContext ctx)
+{
+    struct context_t * g;
 
-            p = p->next;
-        }
-        t.x1 = v[0].x;
-        t.y1 = v[0].y;
-        t.z1 = v[0].z;
-        t.x2 = v[1].x;
-        t.y2 = v[1].y;
-        t.z2 = v[1].z;
-        t.x3 = v[2].x;
-        t.y3 = v[2].y;
-        t.z3 = v[2].z;
+    g = __atomic_load_n(&all_contexts, __ATOMIC_ACQUIRE);
+    for (; g; g = g->next)
+        if (g->ctx == ctx)
+            return g;
 
-        emit_stl_triangle(f, t);
+    pthread_mutex_lock(&contexts_lock);
+    for (g = all_contexts; g; g = g->next) /* another thread was faster */
+        if (g->ctx == ctx)
+            break;
+    if (!g) {
+        g = context_new(ctx);
+        g->next = all_contexts;
+        __atomic_store_n(&all_contexts, g, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&contexts_lock);
+    return g;
+}
 
-        /* GL_QUADS have a strange sequence */
-        t.x2 = v[3].x;
-        t.y2 = v[3].y;
-        t.z2 = v[3].z;
+struct recorder_t * recorder_new(void)
+{
+    struct recorder_t * r;
+
+    init(); /* before ring_frames is looked at */
+    r = calloc(1, sizeof(*r));
+    if (!r) enomem();
+    if (!ring_frames)
+        r->cap = capture_new(); /* else the context's, see ring_attach() */
+    pthread_setspecific(recorder_key, r);
+
+    r->next = __atomic_load_n(&all_recorders, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&all_recorders, &r->next, r, 1,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return r;
+}
 
-        emit_stl_triangle(f, t);
+__attribute__((noinline, cold))
+struct recorder_t * recorder_slow(void)
+{
+    if (!rec)
+        rec = recorder_new();
+    if (!rec->gl) {
+        /* GL calls without a current context, or a toolkit that */
+        /* made it current behind our back                       */
+        if (!rec->own)
+            rec->own = context_new(NULL);
+        ring_switch(rec, rec->own);
     }
+    return rec;
 }
 
-void do_gl_quad_strip(FILE * f, struct prim_t * prim)
+/* the recorder of the calling thread, its current context in gl */
+static inline struct recorder_t * recorder(void)
 {
-    if (!prim) return;
-
-    struct V3_t * p = prim->V3;
-    struct vertex_t   v[3];
-    struct triangle_t t;
+    struct recorder_t * r = rec;
+    if (__builtin_expect(!r || !r->gl, 0))
+        r = recorder_slow();
+    return r;
+}
 
-    /* get 1st two vertices */
-    v[1].x = p->v.x;
-    v[1].y = p->v.y;
-    v[1].z = p->v.z;
-    p = p->next;
-    if (!p) {
-        printf("!!! ERROR do_gl_quad_strip()\n");
-        exit(1); /* FIXME: be more gracefully */
-    }
-    v[2].x = p->v.x;
-    v[2].y = p->v.y;
-    v[2].z = p->v.z;
-    p = p->next;
-    if (!p) {
-        printf("!!! ERROR do_gl_quad_strip()\n");
-        exit(1); /* FIXME: be more gracefully */
+/* glXMakeCurrent(), releasing the context with NULL records nothing */
+void context_make_current(GLXContext ctx)
+{
+    if (!ctx) {
+        if (rec)
+            ring_switch(rec, NULL);
+        return;
     }
-    while (p) {
-        memcpy(&v[0], &v[1], 12);
-        memcpy(&v[1], &v[2], 12);
-        v[2].x = p->v.x;
-        v[2].y = p->v.y;
-        v[2].z = p->v.z;
-
-        t.xn = p->norm->v.x;
-        t.yn = p->norm->v.y;
-        t.zn = p->norm->v.z;
-
-        t.x1 = v[0].x;
-        t.y1 = v[0].y;
-        t.z1 = v[0].z;
-        t.x2 = v[1].x;
-        t.y2 = v[1].y;
-        t.z2 = v[1].z;
-        t.x3 = v[2].x;
-        t.y3 = v[2].y;
-        t.z3 = v[2].z;
-
-        emit_stl_triangle(f, t);
+    if (!rec)
+        rec = recorder_new();
+    ring_switch(rec, context_get(ctx));
+}
 
-        p = p->next;
+/* whether calls are recorded right now. this is all a wrapped */
+/* call costs while no capture is running.                     */
+static inline int dump_on(void)
+{
+    int c = __atomic_load_n(&capturing, __ATOMIC_RELAXED);
+    if (__builtin_expect(!c, 1))
+        return 0;
+    /* the first recorded call sets ogldump up */
+    if (__builtin_expect(c & CAPTURE_INIT, 0)) {
+        init();
+        c = __atomic_load_n(&capturing, __ATOMIC_RELAXED);
     }
+    /* lists are recorded whenever they're compiled */
+    return (c & CAPTURE_FRAMES) || recorder()->list;
 }
 
-void do_gl_triangles(FILE * f, struct prim_t * prim)
+/* ask for a capture of frames frames, from the next frame on. */
+/* safe to call from a signal handler.                         */
+static inline void capture_trigger(uint32_t frames)
 {
-    if (!prim) return;
-
-    struct V3_t * p = prim->V3;
-    struct vertex_t   v[3];
-    struct triangle_t t;
-
-    int n_tri = 0;
+    __atomic_store_n(&frames_request, frames, __ATOMIC_RELEASE);
+}
 
-    while (p) {
+/* end a running capture with the current frame. */
+/* the flight recorder can't be stopped.           */
+static inline void capture_stop(void)
+{
+    __atomic_store_n(&frames_request, 0, __ATOMIC_RELAXED);
+    if (ring_frames)
+        return;
+    if (__atomic_load_n(&capturing, __ATOMIC_RELAXED) & CAPTURE_FRAMES)
+        __atomic_store_n(&frames_left, 1, __ATOMIC_RELAXED);
+}
 
-        t.xn = p->norm->v.x;
-        t.yn = p->norm->v.y;
-        t.zn = p->norm->v.z;
+/* the largest record a draw allocates besides its arrays */
+#define RING_HEADROOM \
+    (sizeof(struct drawelements_t) + 16 * sizeof(float) + 2 * ARENA_ALIGN)
 
-        int i;
-        for (i=0; i<3; i++) {
+/* whether the capture has room for another prim or draw. the */
+/* flight recorder drops what doesn't fit a frame.             */
+static inline int capture_room(struct recorder_t * r)
+{
+    if (ring_frames) {
+        if (__builtin_expect(!r->cap, 0) && !ring_attach(r))
+            return 0;
+        struct arena_chunk_t * c = r->cap->arena.chunk;
+        if (__builtin_expect(c->size - c->used >= RING_HEADROOM, 1))
+            return 1;
+        __atomic_fetch_add(&ring_dropped, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    return !dump_count || __atomic_load_n(&objects_left, __ATOMIC_RELAXED);
+}
 
-            if (!p) {
-                printf("!!! ERROR do_gl_triangles(): i=%d n_tri=%d\n",
-                        i, n_tri);
-                exit(1); /* FIXME: be more gracefully */
-            }
+/* take one prim or draw from the budget of the capture. once */
+/* it's used up the capture ends with the current frame.      */
+static inline int capture_charge(void)
+{
+    uint32_t n;
+
+    if (ring_frames || !dump_count)
+        return 1;
+    n = __atomic_load_n(&objects_left, __ATOMIC_RELAXED);
+    do {
+        if (!n)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&objects_left, &n, n - 1, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    if (n == 1)
+        __atomic_store_n(&frames_left, 1, __ATOMIC_RELAXED);
+    return 1;
+}
 
-            v[i].x = p->v.x;
-            v[i].y = p->v.y;
-            v[i].z = p->v.z;
+static inline int capture_budget(struct recorder_t * r)
+{
+    return capture_room(r) && capture_charge();
+}
 
-            p = p->next;
+/* called at the end of every frame, by any thread */
+void frame_end(void)
+{
+    if (__atomic_load_n(&capturing, __ATOMIC_RELAXED) & CAPTURE_FRAMES) {
+        uint32_t n = __atomic_load_n(&frames_left, __ATOMIC_RELAXED);
+        while (n && !__atomic_compare_exchange_n(&frames_left, &n, n - 1, 1,
+                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+        __atomic_fetch_add(&nFrames, 1, __ATOMIC_RELAXED);
+        if (n == 1) {
+            __atomic_fetch_and(&capturing, ~CAPTURE_FRAMES, __ATOMIC_RELAXED);
+            printf("+++ capture done, %u frames so far\n", nFrames);
         }
+    }
+    if (__atomic_load_n(&frames_request, __ATOMIC_RELAXED)) {
+        uint32_t req = __atomic_exchange_n(&frames_request, 0, __ATOMIC_ACQUIRE);
+        if (req && ring_frames) {
+            /* every recorder freezes its ring at its next swap */
+            __atomic_fetch_add(&nCaptures, 1, __ATOMIC_RELEASE);
+            printf("+++ freezing the last %u frames\n", ring_frames);
+        } else if (req) {
+            __atomic_fetch_add(&nCaptures, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&objects_left, dump_count, __ATOMIC_RELAXED);
+            __atomic_store_n(&frames_left, req, __ATOMIC_RELAXED);
+            __atomic_fetch_or(&capturing, CAPTURE_FRAMES, __ATOMIC_RELAXED);
+            printf("+++ capturing %u frames\n", req);
+        }
+    }
+}
 
-        t.x1 = v[0].x;
-        t.y1 = v[0].y;
-        t.z1 = v[0].z;
-        t.x2 = v[1].x;
-        t.y2 = v[1].y;
-        t.z2 = v[1].z;
-        t.x3 = v[2].x;
-        t.y3 = v[2].y;
-        t.z3 = v[2].z;
-
-        emit_stl_triangle(f, t);
+/**************************************************************/
+/* buffer object state, per recorder as bindings are per context */
 
-        if (p)
-            p = p->next;
-        n_tri++;
+struct buffer_t ** buffer_binding(GLenum target)
+{
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return &recorder()->gl->array_buffer;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return &recorder()->gl->element_buffer;
+        default:
+            return NULL;
     }
 }
 
-void do_gl_triangle_strip(FILE * f, struct prim_t * prim)
+void buffer_gen(GLsizei n, const GLuint * names)
 {
-    if (!prim) return;
-
-    struct V3_t * p = prim->V3;
-    struct vertex_t   v[3];
-    struct triangle_t t;
+    int i;
+    pthread_mutex_lock(&buffers_lock);
+    for (i=0; i<n; i++)
+        buffer_get(names[i]);
+    pthread_mutex_unlock(&buffers_lock);
+}
 
-    /* get 1st two vertices */
-    v[0].x = p->v.x;
-    v[0].y = p->v.y;
-    v[0].z = p->v.z;
-    p = p->next;
-    if (!p) {
-        printf("!!! ERROR do_gl_triangle_strip()\n");
-        exit(1); /* FIXME: be more gracefully */
-    }
-    v[1].x = p->v.x;
-    v[1].y = p->v.y;
-    v[1].z = p->v.z;
-    p = p->next;
-    if (!p) {
-        printf("!!! ERROR do_gl_triangle_strip()\n");
-        exit(1); /* FIXME: be more gracefully */
+void buffer_bind(GLenum target, GLuint name)
+{
+    struct buffer_t ** binding = buffer_binding(target);
+    if (!binding)
+        return;
+    if (!name) {
+        *binding = NULL;
+        return;
     }
-    while (p) {
-        memcpy(&v[0], &v[1], 12); // only diff to do_gl_triangle_fan()
-        memcpy(&v[1], &v[2], 12);
-        v[2].x = p->v.x;
-        v[2].y = p->v.y;
-        v[2].z = p->v.z;
-
-        t.xn = p->norm->v.x;
-        t.yn = p->norm->v.y;
-        t.zn = p->norm->v.z;
-
-        t.x1 = v[0].x;
-        t.y1 = v[0].y;
-        t.z1 = v[0].z;
-        t.x2 = v[1].x;
-        t.y2 = v[1].y;
-        t.z2 = v[1].z;
-        t.x3 = v[2].x;
-        t.y3 = v[2].y;
-        t.z3 = v[2].z;
-
-        emit_stl_triangle(f, t);
+    pthread_mutex_lock(&buffers_lock);
+    *binding = buffer_get(name);
+    pthread_mutex_unlock(&buffers_lock);
+}
 
-        p = p->next;
+void buffer_delete(GLsizei n, const GLuint * names)
+{
+    struct recorder_t * r = recorder();
+    int i;
+
+    /* the struct stays around, other contexts may still point to it */
+    pthread_mutex_lock(&buffers_lock);
+    for (i=0; i<n; i++) {
+        if (!names[i] || names[i] >= nbuffers || !buffers[names[i]])
+            continue;
+        struct buffer_t * b = buffers[names[i]];
+        free(b->data);
+        b->data = NULL;
+        b->size = 0;
+        b->map  = NULL;
+        if (r->gl->array_buffer == b)
+            r->gl->array_buffer = NULL;
+        if (r->gl->element_buffer == b)
+            r->gl->element_buffer = NULL;
     }
+    pthread_mutex_unlock(&buffers_lock);
 }
 
-void do_gl_triangle_fan(FILE * f, struct prim_t * prim)
+void buffer_data(GLenum target, size_t size, const void * data)
 {
-    if (!prim) return;
+    struct buffer_t ** binding = buffer_binding(target);
+    struct buffer_t * b;
 
-    struct V3_t * p = prim->V3;
-    struct vertex_t   v[3];
-    struct triangle_t t;
+    if (!binding || !(b = *binding))
+        return;
+    pthread_mutex_lock(&buffers_lock);
+    char * d = realloc(b->data, size ? size : 1);
+    if (!d) enomem();
+    b->data = d;
+    b->size = size;
+    if (data)
+        memcpy(b->data, data, size);
+    pthread_mutex_unlock(&buffers_lock);
+}
 
-    /* get 1st two vertices */
-    v[0].x = p->v.x;
-    v[0].y = p->v.y;
-    v[0].z = p->v.z;
-    p = p->next;
-    if (!p) {
-        printf("!!! ERROR do_gl_triangle_fan()\n");
-        exit(1); /* FIXME: be more gracefully */
-    }
-    v[1].x = p->v.x;
-    v[1].y = p->v.y;
-    v[1].z = p->v.z;
-    p = p->next;
-    if (!p) {
-        printf("!!! ERROR do_gl_triangle_fan()\n");
-        exit(1); /* FIXME: be more gracefully */
-    }
-    while (p) {
-        memcpy(&v[1], &v[2], 12);
-        v[2].x = p->v.x;
-        v[2].y = p->v.y;
-        v[2].z = p->v.z;
-
-        t.xn = p->norm->v.x;
-        t.yn = p->norm->v.y;
-        t.zn = p->norm->v.z;
-
-        t.x1 = v[0].x;
-        t.y1 = v[0].y;
-        t.z1 = v[0].z;
-        t.x2 = v[1].x;
-        t.y2 = v[1].y;
-        t.z2 = v[1].z;
-        t.x3 = v[2].x;
-        t.y3 = v[2].y;
-        t.z3 = v[2].z;
-
-        emit_stl_triangle(f, t);
+void buffer_subdata(GLenum target, size_t offset, size_t size, const void * data)
+{
+    struct buffer_t ** binding = buffer_binding(target);
+    struct buffer_t * b;
 
-        p = p->next;
-    }
+    if (!binding || !(b = *binding) || !data)
+        return;
+    pthread_mutex_lock(&buffers_lock);
+    if (offset + size <= b->size)
+        memcpy(b->data + offset, data, size);
+    pthread_mutex_unlock(&buffers_lock);
 }
 
-void switch_gl_primitive(int n, struct prim_t * prim)
+/* remember where the app writes to, it is copied back on unmap */
+void buffer_map(GLenum target, void * ptr, size_t offset, size_t length,
+        int writable)
 {
-    char fnamebuf[256];
-    sprintf(fnamebuf, "%s/prim_%.7d.stl", FNAME_PREFIX, n);
-    FILE * f = fopen(fnamebuf, "wb");
-    if (!f) {
-        printf("!!! couldn't fopen(%s)\n", fnamebuf);
+    struct buffer_t ** binding = buffer_binding(target);
+    struct buffer_t * b;
+
+    if (!binding || !(b = *binding))
         return;
+    pthread_mutex_lock(&buffers_lock);
+    if (!ptr || !writable || offset + length > b->size) {
+        b->map = NULL;
+    } else {
+        b->map        = ptr;
+        b->map_offset = offset;
+        b->map_length = length;
     }
+    pthread_mutex_unlock(&buffers_lock);
+}
 
-    fwrite(stl_header, 1, 80, f);
-    int vertices = 0; /* will be written again by fixup_stl() */
-    fwrite(&vertices, 4, 1, f);
+/* has to be called before the real unmap, while map is still valid */
+void buffer_unmap(GLenum target)
+{
+    struct buffer_t ** binding = buffer_binding(target);
+    struct buffer_t * b;
 
-    switch(prim->type) {
-#if 0
-        case GL_POINTS:
-            do_gl_quads(f, prim);
+    if (!binding || !(b = *binding))
+        return;
+    pthread_mutex_lock(&buffers_lock);
+    if (b->map)
+        memcpy(b->data + b->map_offset, b->map, b->map_length);
+    b->map = NULL;
+    pthread_mutex_unlock(&buffers_lock);
+}
+
+/**************************************************************/
+/* modelview matrix stack                                     */
+/* a shadow of GL's modelview stack, so vertices can be taken */
+/* to world space. matrices are column-major, as in GL. the   */
+/* other stacks are not needed and their calls are ignored.   */
+
+/* the top of the modelview stack, NULL while another one is current */
+static inline float * matrix_top(struct recorder_t * r)
+{
+    if (r->gl->matrix_mode != GL_MODELVIEW)
+        return NULL;
+    r->gl->modelview_gen++; /* the caller is going to change it */
+    return r->gl->modelview[r->gl->modelview_depth];
+}
+
+void matrix_mode(GLenum mode)
+{
+    recorder()->gl->matrix_mode = mode;
+}
+
+/* in a list, the top no longer depends on the caller */
+static inline void matrix_loaded(struct recorder_t * r)
+{
+    if (r->list)
+        r->list_absolute |= 1u << r->gl->modelview_depth;
+}
+
+void matrix_load(const float * m)
+{
+    struct recorder_t * r = recorder();
+    float * top = matrix_top(r);
+    if (top) {
+        memcpy(top, m, 16 * sizeof(float));
+        matrix_loaded(r);
+    }
+}
+
+void matrix_mult(const float * m)
+{
+    float * top = matrix_top(recorder());
+    if (top)
+        mat_mul(top, m);
+}
+
+void matrix_identity(void)
+{
+    struct recorder_t * r = recorder();
+    float * top = matrix_top(r);
+    if (top) {
+        mat_identity(top);
+        matrix_loaded(r);
+    }
+}
+
+void matrix_translate(float x, float y, float z)
+{
+    float m[16];
+    mat_identity(m);
+    m[12] = x;
+    m[13] = y;
+    m[14] = z;
+    matrix_mult(m);
+}
+
+void matrix_scale(float x, float y, float z)
+{
+    float m[16];
+    mat_identity(m);
+    m[0]  = x;
+    m[5]  = y;
+    m[10] = z;
+    matrix_mult(m);
+}
+
+/* angle in degrees around the axis x,y,z, as glRotate() */
+void matrix_rotate(float angle, float x, float y, float z)
+{
+    float len = sqrtf(x * x + y * y + z * z);
+    float m[16];
+
+    if (len == 0.0f)
+        return;
+    x /= len;
+    y /= len;
+    z /= len;
+
+    float c = cosf(angle * (float) M_PI / 180.0f);
+    float s = sinf(angle * (float) M_PI / 180.0f);
+    float t = 1.0f - c;
+
+    mat_identity(m);
+    m[0]  = x * x * t + c;
+    m[1]  = y * x * t + z * s;
+    m[2]  = x * z * t - y * s;
+    m[4]  = x * y * t - z * s;
+    m[5]  = y * y * t + c;
+    m[6]  = y * z * t + x * s;
+    m[8]  = x * z * t + y * s;
+    m[9]  = y * z * t - x * s;
+    m[10] = z * z * t + c;
+    matrix_mult(m);
+}
+
+/* over- and underflows are ignored, as GL does */
+void matrix_push(void)
+{
+    struct recorder_t * r = recorder();
+    if (r->gl->matrix_mode != GL_MODELVIEW ||
+            r->gl->modelview_depth + 1 >= MODELVIEW_STACK_DEPTH)
+        return;
+    memcpy(r->gl->modelview[r->gl->modelview_depth + 1],
+            r->gl->modelview[r->gl->modelview_depth], 16 * sizeof(float));
+    r->gl->modelview_depth++;
+    r->list_absolute &= ~(1u << r->gl->modelview_depth);
+    r->list_absolute |= (r->list_absolute << 1) & (1u << r->gl->modelview_depth);
+}
+
+void matrix_pop(void)
+{
+    struct recorder_t * r = recorder();
+    if (r->gl->matrix_mode != GL_MODELVIEW || !r->gl->modelview_depth)
+        return;
+    r->gl->modelview_depth--;
+    r->gl->modelview_gen++;
+}
+
+/* the current modelview matrix for a prim or draw being recorded, */
+/* NULL for the identity. a copy is only made when it changed.     */
+/* *absolute is set if it was loaded in the list being compiled,   */
+/* such a matrix is kept even if it is the identity.               */
+const float * modelview_snapshot(struct recorder_t * r, int * absolute)
+{
+    static const float identity[16] = {
+        1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+    const float * top = r->gl->modelview[r->gl->modelview_depth];
+    int abs = r->list && (r->list_absolute >> r->gl->modelview_depth & 1);
+
+    *absolute = abs;
+    if (r->modelview_snapshot && r->modelview_snapshot_cap == r->cap &&
+            r->modelview_snapshot_gl == r->gl &&
+            r->modelview_snapshot_gen == r->gl->modelview_gen)
+        return r->modelview_snapshot_identity && !abs ?
+            NULL : r->modelview_snapshot;
+
+    float * m = arena_alloc(&r->cap->arena, 16 * sizeof(float));
+    memcpy(m, top, 16 * sizeof(float));
+    r->modelview_snapshot          = m;
+    r->modelview_snapshot_cap      = r->cap;
+    r->modelview_snapshot_gl       = r->gl;
+    r->modelview_snapshot_gen      = r->gl->modelview_gen;
+    r->modelview_snapshot_identity = !memcmp(top, identity, sizeof(identity));
+    return r->modelview_snapshot_identity && !abs ? NULL : m;
+}
+
+/**************************************************************/
+/* display lists                                              */
+/* a list is recorded once, into a capture of its own, while  */
+/* it's compiled. glCallList() only records a reference and   */
+/* the modelview, the geometry is taken to world space when   */
+/* it's exported. lists are compiled relative to an identity  */
+/* modelview, their net effect on it is applied by every call */
+
+#define DLIST_NESTING_MAX 64 /* GL_MAX_LIST_NESTING, at least 64 */
+
+/* a list that does glLoadIdentity() or glLoadMatrix() doesn't */
+/* depend on the caller's modelview from there on. the objects  */
+/* recorded after it are absolute, their modelview is used as   */
+/* is, and if its net transform is too it replaces the caller's. */
+struct dlist_t {
+    GLuint             name;
+    int                refs;  /* the table's and one per recorded call */
+    GLenum             mode;  /* GL_COMPILE or GL_COMPILE_AND_EXECUTE */
+    struct capture_t * cap;   /* what it draws */
+    float              net[16]; /* what it does to the modelview */
+    int                net_identity;
+    int                absolute;     /* net was loaded, not multiplied */
+    int                has_absolute; /* it or a list it calls draws some */
+    struct dlist_t   * next_retired; /* see dlist_publish() */
+    uint64_t           hash;    /* of the content, see hash_list() */
+    int                hashed;
+};
+
+/* dlists is indexed by name and holds the current version of */
+/* every list. recompiling a list makes a new version, captures */
+/* still refer to the one they called. glCallList() looks it up */
+/* without a lock: versions and grown tables are published      */
+/* atomically, and what they replace is only let go once no     */
+/* thread can be looking at it any more.                        */
+struct dlist_table_t {
+    GLuint           n;
+    struct dlist_t * slot[];
+};
+
+pthread_mutex_t        dlists_lock = PTHREAD_MUTEX_INITIALIZER; /* writers */
+struct dlist_table_t * dlists      = NULL;
+
+void dlist_put(struct dlist_t * l)
+{
+    if (__atomic_sub_fetch(&l->refs, 1, __ATOMIC_ACQ_REL))
+        return;
+    capture_release(l->cap);
+    free(l);
+}
+
+/* waits until every thread that was in dlist_call() left it. */
+/* a thread entering it later sees what was published before. */
+void dlist_quiesce(void)
+{
+    struct recorder_t * r;
+    uint32_t seq;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    r = __atomic_load_n(&all_recorders, __ATOMIC_ACQUIRE);
+    for (; r; r = r->next) {
+        seq = __atomic_load_n(&r->dlist_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            while (__atomic_load_n(&r->dlist_seq, __ATOMIC_ACQUIRE) == seq)
+                sched_yield();
+    }
+}
+
+/* names first to first + n - 1 are l from now on, NULL deletes them */
+void dlist_publish(GLuint first, GLsizei n, struct dlist_t * l)
+{
+    struct dlist_table_t * t, * grown, * old_table = NULL;
+    struct dlist_t * retired = NULL, * old;
+    GLuint name;
+    GLsizei i;
+
+    pthread_mutex_lock(&dlists_lock);
+    t = dlists;
+    if (l && (!t || first >= t->n)) {
+        GLuint size = t ? t->n : 256;
+        while (size <= first)
+            size *= 2;
+        grown = calloc(1, sizeof(*grown) + size * sizeof(grown->slot[0]));
+        if (!grown) enomem();
+        grown->n = size;
+        if (t)
+            memcpy(grown->slot, t->slot, t->n * sizeof(t->slot[0]));
+        __atomic_store_n(&dlists, grown, __ATOMIC_RELEASE);
+        old_table = t;
+        t = grown;
+    }
+    for (i=0; i<n && t; i++) {
+        name = first + i;
+        if (name < first || name >= t->n)
             break;
+        old = t->slot[name];
+        __atomic_store_n(&t->slot[name], l, __ATOMIC_RELEASE);
+        if (old) {
+            old->next_retired = retired;
+            retired = old;
+        }
+    }
+    pthread_mutex_unlock(&dlists_lock);
+
+    if (!retired && !old_table)
+        return;
+    dlist_quiesce();
+    free(old_table);
+    while ((old = retired)) {
+        retired = old->next_retired;
+        dlist_put(old);
+    }
+}
+
+/* whether l draws anything absolute, the lists it calls are done */
+int dlist_has_absolute(struct dlist_t * l)
+{
+    struct prim_t * p;
+    struct drawelements_t * d;
+    struct listcall_t * call;
+
+    for (p = l->cap->all_prims; p; p = p->next)
+        if (p->absolute)
+            return 1;
+    for (d = l->cap->all_drawelements; d; d = d->next)
+        if (d->absolute)
+            return 1;
+    for (call = l->cap->all_listcalls; call; call = call->next)
+        if (call->absolute || call->list->has_absolute)
+            return 1;
+    return 0;
+}
+
+/* glNewList(): record into the list until glEndList() */
+void dlist_new(GLuint name, GLenum mode)
+{
+    struct recorder_t * r = recorder();
+    struct dlist_t * l;
+
+    if (!name || r->list)
+        return; /* GL_INVALID_VALUE or GL_INVALID_OPERATION */
+    l = calloc(1, sizeof(*l));
+    if (!l) enomem();
+    l->name = name;
+    l->refs = 1;
+    l->mode = mode;
+    l->cap  = capture_new();
+
+    r->saved_cap         = r->cap;
+    r->saved_matrix_mode = r->gl->matrix_mode;
+    r->saved_depth       = r->gl->modelview_depth;
+    memcpy(r->saved_modelview, r->gl->modelview, sizeof(r->gl->modelview));
+    mat_identity(r->gl->modelview[r->gl->modelview_depth]);
+    r->gl->modelview_gen++;
+    r->list_absolute = 0;
+    r->cap     = l->cap;
+    r->list    = l;
+    r->list_gl = r->gl;
+    __atomic_fetch_add(&capturing, CAPTURE_LIST, __ATOMIC_RELAXED);
+}
+
+void dlist_call(struct recorder_t * r, GLuint name);
+
+/* glEndList(), the list replaces its previous version */
+void dlist_end(struct recorder_t * r)
+{
+    struct dlist_t * l = r->list;
+    struct context_t * g = r->list_gl;
+    static const float identity[16] = {
+        1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+
+    if (!l)
+        return;
+    r->current_prim = NULL; /* a glBegin() without glEnd() */
+    r->prim_dropped = 0;
+    memcpy(l->net, g->modelview[g->modelview_depth], sizeof(l->net));
+    l->net_identity = !memcmp(l->net, identity, sizeof(identity));
+    l->absolute     = r->list_absolute >> g->modelview_depth & 1;
+    l->has_absolute = dlist_has_absolute(l);
+
+    r->cap             = r->saved_cap;
+    g->matrix_mode     = r->saved_matrix_mode;
+    g->modelview_depth = r->saved_depth;
+    memcpy(g->modelview, r->saved_modelview, sizeof(g->modelview));
+    g->modelview_gen++;
+    r->list    = NULL;
+    r->list_gl = NULL;
+    __atomic_fetch_sub(&capturing, CAPTURE_LIST, __ATOMIC_RELAXED);
+
+    verbprintf(TRACE_PRIMS, "list %u has %d prims, %d draws and %d calls\n",
+            l->name, l->cap->nPrim, l->cap->nDrawElements, l->cap->nListCalls);
+
+    dlist_publish(l->name, 1, l);
+
+    /* it was executed as it was compiled */
+    if (l->mode == GL_COMPILE_AND_EXECUTE && r->gl)
+        dlist_call(r, l->name);
+}
+
+/* glCallList(). the call is recorded if it draws anything, into */
+/* the list being compiled or the capture, and the list's net    */
+/* transform is applied to the shadow modelview in any case.     */
+void dlist_call(struct recorder_t * r, GLuint name)
+{
+    struct dlist_table_t * t;
+    struct dlist_t * l;
+    struct capture_t * c;
+    uint32_t seq = r->dlist_seq;
+    float * top;
+
+    /* only this thread writes it, dlist_quiesce() reads it */
+    __atomic_store_n(&r->dlist_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    t = __atomic_load_n(&dlists, __ATOMIC_ACQUIRE);
+    l = t && name < t->n ? __atomic_load_n(&t->slot[name], __ATOMIC_ACQUIRE) : NULL;
+    if (!l) {
+        __atomic_store_n(&r->dlist_seq, seq + 2, __ATOMIC_RELEASE);
+        return;
+    }
+    c = l->cap;
+    if ((c->nPrim || c->nDrawElements || c->nListCalls) && !r->current_prim &&
+            (r->list || (dump_on() && capture_budget(r)))) {
+        struct listcall_t * p = arena_alloc(&r->cap->arena, sizeof(*p));
+        __atomic_add_fetch(&l->refs, 1, __ATOMIC_RELAXED);
+        p->next      = NULL;
+        p->n         = __atomic_fetch_add(&nListCalls, 1, __ATOMIC_RELAXED);
+        p->frame     = __atomic_load_n(&nFrames, __ATOMIC_RELAXED);
+        p->capture   = __atomic_load_n(&nCaptures, __ATOMIC_RELAXED) - 1;
+        p->list      = l;
+        p->modelview = modelview_snapshot(r, &p->absolute);
+        if (!r->cap->last_listcall)
+            r->cap->all_listcalls = p;
+        else
+            r->cap->last_listcall->next = p;
+        r->cap->last_listcall = p;
+        r->cap->nListCalls++;
+        verbprintf(TRACE_PRIMS, "glCallList(%u); /* [%d] */\n", name, p->n);
+    }
+    if ((l->absolute || !l->net_identity) && (top = matrix_top(r))) {
+        if (l->absolute) {
+            memcpy(top, l->net, sizeof(l->net));
+            matrix_loaded(r);
+        } else {
+            mat_mul(top, l->net);
+        }
+    }
+    __atomic_store_n(&r->dlist_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* glCallLists(), names are offset by glListBase() */
+void dlist_call_n(GLsizei n, GLenum type, const GLvoid * lists)
+{
+    struct recorder_t * r = recorder();
+    const unsigned char * p = lists;
+    GLsizei i;
+    GLuint name;
+
+    for (i=0; i<n; i++) {
+        switch (type) {
+            case GL_BYTE:
+                name = ((const GLbyte *) lists)[i];
+                break;
+            case GL_UNSIGNED_BYTE:
+                name = ((const GLubyte *) lists)[i];
+                break;
+            case GL_SHORT:
+                name = ((const GLshort *) lists)[i];
+                break;
+            case GL_UNSIGNED_SHORT:
+                name = ((const GLushort *) lists)[i];
+                break;
+            case GL_INT:
+                name = ((const GLint *) lists)[i];
+                break;
+            case GL_UNSIGNED_INT:
+                name = ((const GLuint *) lists)[i];
+                break;
+            case GL_FLOAT:
+                name = ((const GLfloat *) lists)[i];
+                break;
+            /* big endian byte sequences */
+            case GL_2_BYTES:
+                name = (p[2*i] << 8) | p[2*i+1];
+                break;
+            case GL_3_BYTES:
+                name = (p[3*i] << 16) | (p[3*i+1] << 8) | p[3*i+2];
+                break;
+            case GL_4_BYTES:
+                name = (p[4*i] << 24) | (p[4*i+1] << 16) |
+                    (p[4*i+2] << 8) | p[4*i+3];
+                break;
+            default:
+                return; /* GL_INVALID_ENUM */
+        }
+        dlist_call(r, r->gl->list_base + name);
+    }
+}
+
+/* the versions already called stay with their captures */
+void dlist_delete(GLuint first, GLsizei n)
+{
+    dlist_publish(first, n, NULL);
+}
+
+/**************************************************************/
+/* recording */
+
+/* NULL once the capture's budget is used up */
+struct prim_t * new_prim(GLenum type)
+{
+    struct recorder_t * r = recorder();
+    if (!r->list && !capture_budget(r))
+        return NULL;
+
+    struct capture_t * c = r->cap;
+    struct prim_t * p = arena_alloc(&c->arena, sizeof(*p));
+    if (!c->last_prim)
+        c->all_prims = p;
+    else
+        c->last_prim->next = p;
+    c->last_prim = p;
+
+    p->next    = NULL;
+    p->n       = __atomic_fetch_add(&nPrim, 1, __ATOMIC_RELAXED);
+    p->frame   = __atomic_load_n(&nFrames, __ATOMIC_RELAXED);
+    p->capture = __atomic_load_n(&nCaptures, __ATOMIC_RELAXED) - 1;
+    p->nV3     = 0;
+    p->first   = c->vstore.count;
+    p->type    = type;
+    p->modelview = modelview_snapshot(r, &p->absolute);
+    c->nPrim++;
+    return p;
+}
+
+void new_V3(
+        float x,
+        float y,
+        float z)
+{
+    struct recorder_t * r = recorder();
+    if (!r->current_prim) {
+        if (!r->prim_dropped)
+            printf("!!! ignoring V3 outside of prim\n");
+        return;
+    }
+    struct vstore_t * s = &r->cap->vstore;
+    if (s->count == s->size) {
+        if (r->cap->arena.fixed) {
+            /* the flight recorder's frame is full, drop the prim */
+            s->count = r->current_prim->first;
+            r->current_prim->nV3 = 0;
+            r->current_prim = NULL;
+            r->prim_dropped = 1;
+            __atomic_fetch_add(&ring_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        vstore_grow(s);
+    }
+
+    float * v = &s->v[3 * s->count];
+    float * n = &s->n[3 * s->count];
+    v[0] = x;
+    v[1] = y;
+    v[2] = z;
+    n[0] = r->gl->norm_cur.x;
+    n[1] = r->gl->norm_cur.y;
+    n[2] = r->gl->norm_cur.z;
+    s->count++;
+    r->current_prim->nV3++;
+}
+
+void new_N3(
+        float x,
+        float y,
+        float z)
+{
+    struct recorder_t * r = recorder();
+    r->gl->norm_cur.x = x;
+    r->gl->norm_cur.y = y;
+    r->gl->norm_cur.z = z;
+}
+
+/* copies vertices min_index to max_index, from client memory or */
+/* the shadow of a buffer object. ptr_copy stays NULL on failure. */
+void copy_vertexpointer(struct vertexpointer_t * v)
+{
+    size_t first = (size_t) v->min_index * v->stride;
+    size_t len   = (size_t) (v->max_index - v->min_index) * v->stride
+                   + v->size * v->sizeof_type;
+    const char * src = v->ptr;
+
+    v->ptr_copy = NULL;
+    if (v->buffer) {
+        /* another thread may reallocate the shadow meanwhile */
+        pthread_mutex_lock(&buffers_lock);
+        if (!v->buffer->data ||
+                (uintptr_t) v->ptr + first + len > v->buffer->size) {
+            pthread_mutex_unlock(&buffers_lock);
+            printf("!!! vertices outside of buffer object %d\n",
+                    v->buffer->name);
+            return;
+        }
+        src = v->buffer->data + (uintptr_t) v->ptr + first;
+        v->ptr_copy = capture_copy(recorder()->cap, src, len);
+        pthread_mutex_unlock(&buffers_lock);
+        return;
+    } else if (!src) {
+        return;
+    } else {
+        src += first;
+    }
+
+    v->ptr_copy = capture_copy(recorder()->cap, src, len);
+}
+
+/**************************************************************/
+/* vertex format conversion                                   */
+/* array draws keep the vertices in the app's format, they're */
+/* converted to packed x,y,z floats when exported. there is a */
+/* kernel per component type and size, so the inner loops    */
+/* have constant trip counts the compiler can vectorize.      */
+
+typedef void (*vconvert_fn)(float * dst, const char * src,
+        uint32_t stride, uint32_t n);
+
+/* size 2 gets z = 0, size 4 is divided by w */
+#define VCONVERT(name, type, size)                                     \
+void name(float * dst, const char * src, uint32_t stride, uint32_t n)  \
+{                                                                      \
+    uint32_t i;                                                        \
+    for (i=0; i<n; i++, src+=stride, dst+=3) {                         \
+        const type * s = (const type *) src;                           \
+        float x = s[0];                                                \
+        float y = s[1];                                                \
+        float z = size > 2 ? (float) s[size > 2 ? 2 : 0] : 0.0f;       \
+        if (size > 3) {                                                \
+            float w = s[size > 3 ? 3 : 0];                             \
+            if (w != 0.0f && w != 1.0f) {                              \
+                x /= w;                                                \
+                y /= w;                                                \
+                z /= w;                                                \
+            }                                                          \
+        }                                                              \
+        dst[0] = x;                                                    \
+        dst[1] = y;                                                    \
+        dst[2] = z;                                                    \
+    }                                                                  \
+}
+
+VCONVERT(vconvert_b2, GLbyte,   2)
+VCONVERT(vconvert_b3, GLbyte,   3)
+VCONVERT(vconvert_b4, GLbyte,   4)
+VCONVERT(vconvert_s2, GLshort,  2)
+VCONVERT(vconvert_s3, GLshort,  3)
+VCONVERT(vconvert_s4, GLshort,  4)
+VCONVERT(vconvert_i2, GLint,    2)
+VCONVERT(vconvert_i3, GLint,    3)
+VCONVERT(vconvert_i4, GLint,    4)
+VCONVERT(vconvert_f2, GLfloat,  2)
+VCONVERT(vconvert_f3, GLfloat,  3)
+VCONVERT(vconvert_f4, GLfloat,  4)
+VCONVERT(vconvert_d2, GLdouble, 2)
+VCONVERT(vconvert_d3, GLdouble, 3)
+VCONVERT(vconvert_d4, GLdouble, 4)
+
+/* returns NULL for formats neither glVertexPointer() nor */
+/* glNormalPointer() allow. GL_BYTE is for normals only.  */
+vconvert_fn vconvert_lookup(GLenum type, GLint size)
+{
+    static const vconvert_fn kernels[5][3] = {
+        { vconvert_b2, vconvert_b3, vconvert_b4 },
+        { vconvert_s2, vconvert_s3, vconvert_s4 },
+        { vconvert_i2, vconvert_i3, vconvert_i4 },
+        { vconvert_f2, vconvert_f3, vconvert_f4 },
+        { vconvert_d2, vconvert_d3, vconvert_d4 },
+    };
+    int t;
+
+    if (size < 2 || size > 4)
+        return NULL;
+    switch (type) {
+        case GL_BYTE:   t = 0; break;
+        case GL_SHORT:  t = 1; break;
+        case GL_INT:    t = 2; break;
+        case GL_FLOAT:  t = 3; break;
+        case GL_DOUBLE: t = 4; break;
+        default:        return NULL;
+    }
+    return kernels[t][size - 2];
+}
+
+/* converts the elements min_index to max_index of an array into dst */
+void vconvert(float * dst, const struct vertexpointer_t * v)
+{
+    uint32_t n = v->max_index - v->min_index + 1;
+
+    /* the common case needs no conversion at all */
+    if (v->type == GL_FLOAT && v->size == 3 && v->stride == 12) {
+        memcpy(dst, v->ptr_copy, n * 12);
+        return;
+    }
+    vconvert_lookup(v->type, v->size)(dst, v->ptr_copy, v->stride, n);
+}
+
+/**************************************************************/
+/* index range scan                                           */
+/* min/max reduction over index arrays, vectorized where the  */
+/* cpu supports it. the kernels are picked once at load time. */
+
+typedef void (*index_range_fn)(const void * data, uint32_t n,
+        uint32_t * min, uint32_t * max);
+
+#define SCALAR_RANGE(name, type)                                       \
+void name(const void * data, uint32_t n, uint32_t * min, uint32_t * max) \
+{                                                                      \
+    const type * p = data;                                             \
+    uint32_t lo = *min, hi = *max;                                     \
+    uint32_t i;                                                        \
+    for (i=0; i<n; i++) {                                              \
+        if (p[i] < lo) lo = p[i];                                      \
+        if (p[i] > hi) hi = p[i];                                      \
+    }                                                                  \
+    *min = lo;                                                         \
+    *max = hi;                                                         \
+}
+
+/* all kernels widen [*min, *max], which the caller initializes. */
+/* after a vector pass every lane holds an actual index value.    */
+SCALAR_RANGE(index_range_u8_scalar,  uint8_t)
+SCALAR_RANGE(index_range_u16_scalar, uint16_t)
+SCALAR_RANGE(index_range_u32_scalar, uint32_t)
+
+#ifdef __SSE2__
+/* SSE2 lacks unsigned 16 and 32 bit min/max, so the indices are */
+/* biased into the signed range and compared there               */
+
+void index_range_u8_sse2(const void * data, uint32_t n,
+        uint32_t * min, uint32_t * max)
+{
+    const uint8_t * p = data;
+    __m128i lo = _mm_set1_epi8(-1);
+    __m128i hi = _mm_setzero_si128();
+    uint8_t l[16], h[16];
+    uint32_t i;
+
+    for (i=0; i+16<=n; i+=16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+        lo = _mm_min_epu8(lo, x);
+        hi = _mm_max_epu8(hi, x);
+    }
+    _mm_storeu_si128((__m128i *) l, lo);
+    _mm_storeu_si128((__m128i *) h, hi);
+    if (i) {
+        index_range_u8_scalar(l, 16, min, max);
+        index_range_u8_scalar(h, 16, min, max);
+    }
+    index_range_u8_scalar(p + i, n - i, min, max);
+}
+
+void index_range_u16_sse2(const void * data, uint32_t n,
+        uint32_t * min, uint32_t * max)
+{
+    const uint16_t * p = data;
+    const __m128i bias = _mm_set1_epi16((short) 0x8000);
+    __m128i lo = _mm_set1_epi16(0x7fff);
+    __m128i hi = _mm_set1_epi16((short) 0x8000);
+    uint16_t l[8], h[8];
+    uint32_t i;
+
+    for (i=0; i+8<=n; i+=8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+        x  = _mm_xor_si128(x, bias);
+        lo = _mm_min_epi16(lo, x);
+        hi = _mm_max_epi16(hi, x);
+    }
+    _mm_storeu_si128((__m128i *) l, _mm_xor_si128(lo, bias));
+    _mm_storeu_si128((__m128i *) h, _mm_xor_si128(hi, bias));
+    if (i) {
+        index_range_u16_scalar(l, 8, min, max);
+        index_range_u16_scalar(h, 8, min, max);
+    }
+    index_range_u16_scalar(p + i, n - i, min, max);
+}
+
+void index_range_u32_sse2(const void * data, uint32_t n,
+        uint32_t * min, uint32_t * max)
+{
+    const uint32_t * p = data;
+    const __m128i bias = _mm_set1_epi32((int) 0x80000000);
+    __m128i lo = _mm_set1_epi32(0x7fffffff);
+    __m128i hi = _mm_set1_epi32((int) 0x80000000);
+    uint32_t l[4], h[4];
+    uint32_t i;
+
+    for (i=0; i+4<=n; i+=4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+        x = _mm_xor_si128(x, bias);
+        __m128i m = _mm_cmpgt_epi32(lo, x);
+        lo = _mm_or_si128(_mm_and_si128(m, x), _mm_andnot_si128(m, lo));
+        m  = _mm_cmpgt_epi32(x, hi);
+        hi = _mm_or_si128(_mm_and_si128(m, x), _mm_andnot_si128(m, hi));
+    }
+    _mm_storeu_si128((__m128i *) l, _mm_xor_si128(lo, bias));
+    _mm_storeu_si128((__m128i *) h, _mm_xor_si128(hi, bias));
+    if (i) {
+        index_range_u32_scalar(l, 4, min, max);
+        index_range_u32_scalar(h, 4, min, max);
+    }
+    index_range_u32_scalar(p + i, n - i, min, max);
+}
 #endif
-#if 1
-        case GL_QUADS:
-            do_gl_quads(f, prim);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AVX2_RANGE(name, scalar, type, lanes, vmin, vmax, init_lo)      \
+__attribute__((target("avx2")))                                       \
+void name(const void * data, uint32_t n, uint32_t * min, uint32_t * max) \
+{                                                                      \
+    const type * p = data;                                             \
+    __m256i lo = init_lo;                                              \
+    __m256i hi = _mm256_setzero_si256();                               \
+    type l[lanes], h[lanes];                                           \
+    uint32_t i;                                                        \
+    for (i=0; i+lanes<=n; i+=lanes) {                                  \
+        __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));      \
+        lo = vmin(lo, x);                                              \
+        hi = vmax(hi, x);                                              \
+    }                                                                  \
+    _mm256_storeu_si256((__m256i *) l, lo);                            \
+    _mm256_storeu_si256((__m256i *) h, hi);                            \
+    if (i) {                                                           \
+        scalar(l, lanes, min, max);                                    \
+        scalar(h, lanes, min, max);                                    \
+    }                                                                  \
+    scalar(p + i, n - i, min, max);                                    \
+}
+
+AVX2_RANGE(index_range_u8_avx2, index_range_u8_scalar, uint8_t, 32,
+        _mm256_min_epu8, _mm256_max_epu8, _mm256_set1_epi8(-1))
+AVX2_RANGE(index_range_u16_avx2, index_range_u16_scalar, uint16_t, 16,
+        _mm256_min_epu16, _mm256_max_epu16, _mm256_set1_epi16(-1))
+AVX2_RANGE(index_range_u32_avx2, index_range_u32_scalar, uint32_t, 8,
+        _mm256_min_epu32, _mm256_max_epu32, _mm256_set1_epi32(-1))
+#endif
+
+struct index_range_t {
+    const char     * name;
+    index_range_fn   u8;
+    index_range_fn   u16;
+    index_range_fn   u32;
+} index_range = {
+    "scalar",
+    index_range_u8_scalar,
+    index_range_u16_scalar,
+    index_range_u32_scalar,
+};
+
+void index_range_init(void)
+{
+#ifdef __SSE2__
+    index_range.name = "sse2";
+    index_range.u8   = index_range_u8_sse2;
+    index_range.u16  = index_range_u16_sse2;
+    index_range.u32  = index_range_u32_sse2;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        index_range.name = "avx2";
+        index_range.u8   = index_range_u8_avx2;
+        index_range.u16  = index_range_u16_avx2;
+        index_range.u32  = index_range_u32_avx2;
+    }
+#endif
+}
+
+/* sets min_index and max_index of the draw's vertexpointer */
+void set_index_range_DrawElements(struct drawelements_t * p)
+{
+    uint32_t min = UINT32_MAX;
+    uint32_t max = 0;
+
+    switch (p->type) {
+        case GL_UNSIGNED_BYTE:
+            index_range.u8(p->indices, p->count, &min, &max);
             break;
-        case GL_QUAD_STRIP:
-            do_gl_quad_strip(f, prim);
+        case GL_UNSIGNED_SHORT:
+            index_range.u16(p->indices, p->count, &min, &max);
+            break;
+        case GL_UNSIGNED_INT:
+            index_range.u32(p->indices, p->count, &min, &max);
+            break;
+        default:
+            printf("!!! FIXME: support DrawElements() type 0x%4.4x\n",
+                    p->type);
+    }
+    if (min > max)
+        min = max = 0;
+    p->vertexpointer.min_index = min;
+    p->vertexpointer.max_index = max;
+}
+
+void dump_de(struct drawelements_t * p)
+{
+
+    uint32_t * ind = p->indices;
+    int i;
+    printf("drawelements type 0x%4.4x, mode 0x%4.4x, sizeof_type %d\n",
+            p->type, p->mode, p->sizeof_type);
+    printf("indices:\n");
+    for (i=0; i<p->count; i++){
+        printf("%8.8x ", ind[i]);
+        if ((i%8)==7)
+            printf("\n");
+    }
+    printf("\n");
+    struct vertexpointer_t * vp = &p->vertexpointer;
+    printf("vertexpointer size %d, type 0x%4.4x, stride %d, sizeof_type %d, min_index 0x%8.8x, max_index 0x%8.8x\n",
+            vp->size, vp->type, vp->stride, vp->sizeof_type, vp->min_index, vp->max_index);
+    printf("\n");
+    printf("\n");
+    return;
+    float * f = vp->ptr_copy;
+    for (i=0; i<p->count; i++){
+        printf("%2.3e ", f[ind[i] - vp->min_index]);
+        if ((i%8)==7)
+            printf("\n");
+    }
+}
+
+
+int index_size(GLenum type)
+{
+    switch (type) {
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_UNSIGNED_SHORT:
+            return 2;
+        case GL_UNSIGNED_INT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+/* the common part of all array draws. returns NULL if the draw */
+/* can't be recorded, the caller fills in the vertex range. it's */
+/* only charged to the capture once link_draw() keeps it.        */
+struct drawelements_t * new_draw(struct recorder_t * r, GLenum mode,
+        GLsizei count)
+{
+    if (!gl_mode_has_triangles(mode)) {
+        verbprintf(TRACE_PRIMS, "ignoring draw of %s, STL has triangles only\n",
+                prim_name(mode));
+        return NULL;
+    }
+    if (count <= 0)
+        return NULL;
+    if (!r->gl->vertexpointer.size || !r->gl->vertexpointer.enabled) {
+        printf("!!! ignoring array draw without GL_VERTEX_ARRAY\n");
+        return NULL;
+    }
+    if (!r->list && !capture_room(r))
+        return NULL;
+
+    struct drawelements_t * p = arena_alloc(&r->cap->arena, sizeof(*p));
+    p->next          = NULL;
+    p->mode          = mode;
+    p->count         = count;
+    p->type          = 0;
+    p->indices       = NULL;
+    p->sizeof_type   = 0;
+    p->frame         = __atomic_load_n(&nFrames, __ATOMIC_RELAXED);
+    p->capture       = __atomic_load_n(&nCaptures, __ATOMIC_RELAXED) - 1;
+    p->modelview     = modelview_snapshot(r, &p->absolute);
+    p->vertexpointer = r->gl->vertexpointer;
+
+    p->normalpointer   = r->gl->normalpointer;
+    p->texcoordpointer = r->gl->texcoordpointer;
+    p->colorpointer    = r->gl->colorpointer;
+    if (!p->normalpointer.enabled)
+        p->normalpointer.size = 0;
+    if (!p->texcoordpointer.enabled)
+        p->texcoordpointer.size = 0;
+    if (!p->colorpointer.enabled)
+        p->colorpointer.size = 0;
+    return p;
+}
+
+/* copy another array of p over the range of its vertices. */
+/* it's dropped if that fails, the draw itself is kept.    */
+void copy_attribpointer(struct drawelements_t * p, struct vertexpointer_t * a)
+{
+    if (!a->size)
+        return;
+    a->min_index = p->vertexpointer.min_index;
+    a->max_index = p->vertexpointer.max_index;
+    copy_vertexpointer(a);
+    if (!a->ptr_copy)
+        a->size = 0;
+}
+
+/* copy the referenced vertices and queue the draw for export */
+void link_draw(struct recorder_t * r, struct drawelements_t * p)
+{
+    struct capture_t * c = r->cap;
+
+    copy_vertexpointer(&p->vertexpointer);
+    if (!p->vertexpointer.ptr_copy)
+        return; /* p stays in the arena until the capture is released */
+    copy_attribpointer(p, &p->normalpointer);
+    copy_attribpointer(p, &p->texcoordpointer);
+    copy_attribpointer(p, &p->colorpointer);
+    if (!r->list && !capture_charge())
+        return;
+
+    if (!c->last_drawelements)
+        c->all_drawelements = p;
+    else
+        c->last_drawelements->next = p;
+    c->last_drawelements = p;
+    c->nDrawElements++;
+    p->n = __atomic_fetch_add(&nDrawElements, 1, __ATOMIC_RELAXED);
+}
+
+void new_DrawElements( GLenum mode, GLsizei count,
+        GLenum type, const GLvoid *indices )
+{
+    int sizeof_type = index_size(type);
+    if (!sizeof_type) {
+        printf("!!! ERROR: glDrawElements() with unknown type 0x%x\n", type);
+        return;
+    }
+
+    struct recorder_t * r = recorder();
+    struct drawelements_t * p = new_draw(r, mode, count);
+    if (!p)
+        return;
+
+    struct capture_t * c = r->cap;
+    size_t len = (size_t) sizeof_type * (size_t) count;
+    p->type        = type;
+    p->sizeof_type = sizeof_type;
+
+    /* with a bound GL_ELEMENT_ARRAY_BUFFER indices is an offset */
+    if (r->gl->element_buffer) {
+        struct buffer_t * b = r->gl->element_buffer;
+        pthread_mutex_lock(&buffers_lock);
+        if (!b->data || len > b->size || (uintptr_t) indices > b->size - len) {
+            pthread_mutex_unlock(&buffers_lock);
+            printf("!!! indices outside of buffer object %d\n", b->name);
+            return;
+        }
+        p->indices = capture_copy(c, b->data + (uintptr_t) indices, len);
+        pthread_mutex_unlock(&buffers_lock);
+    } else if (indices) {
+        p->indices = capture_copy(c, indices, len);
+    }
+    if (!p->indices)
+        return;
+    set_index_range_DrawElements(p);
+
+    link_draw(r, p);
+    //	dump_de(p);
+}
+
+/* count consecutive vertices, starting at first */
+void new_DrawArrays( GLenum mode, GLint first, GLsizei count )
+{
+    struct recorder_t * r = recorder();
+    if (first < 0)
+        return;
+    struct drawelements_t * p = new_draw(r, mode, count);
+    if (!p)
+        return;
+
+    /* count > 0 here, the sum fits unsigned */
+    p->vertexpointer.min_index = first;
+    p->vertexpointer.max_index = (uint32_t) first + (uint32_t) count - 1;
+
+    link_draw(r, p);
+}
+
+int gl_type_size(GLenum type)
+{
+    switch (type) {
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return 1;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+            return 2;
+        case GL_INT:
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+            return 4;
+        case GL_DOUBLE:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+/* the common part of all gl*Pointer(), the caller checks the format */
+void set_pointer(struct vertexpointer_t * p, GLint size, GLenum type,
+        GLsizei stride, const GLvoid *ptr )
+{
+    p->size   = size;
+    p->type   = type;
+    p->ptr    = ptr;
+    p->buffer = recorder()->gl->array_buffer;
+    p->stride = stride;
+
+    p->min_index = 0;
+    p->max_index = 0;
+    p->ptr_copy  = NULL;
+
+    p->sizeof_type = gl_type_size(type);
+
+    /* a stride of 0 means tightly packed, we prefer a correct stride value */
+    if (p->stride == 0){
+        p->stride = p->sizeof_type * p->size;
+    }
+}
+
+/* on errors the array is unset, so no stale pointer gets used */
+void new_VertexPointer( GLint size, GLenum type,
+        GLsizei stride, const GLvoid *ptr )
+{
+    struct vertexpointer_t * p = &recorder()->gl->vertexpointer;
+    if (type == GL_BYTE || !vconvert_lookup(type, size)) {
+        printf("!!! unsupported new_VertexPointer() size %d type 0x%x\n",
+                size, type);
+        p->size = 0;
+        return;
+    }
+    set_pointer(p, size, type, stride, ptr);
+}
+
+void new_NormalPointer( GLenum type, GLsizei stride, const GLvoid *ptr )
+{
+    struct vertexpointer_t * p = &recorder()->gl->normalpointer;
+    if (!vconvert_lookup(type, 3)) {
+        printf("!!! unsupported new_NormalPointer() type 0x%x\n", type);
+        p->size = 0;
+        return;
+    }
+    set_pointer(p, 3, type, stride, ptr);
+}
+
+void new_TexCoordPointer( GLint size, GLenum type,
+        GLsizei stride, const GLvoid *ptr )
+{
+    struct vertexpointer_t * p = &recorder()->gl->texcoordpointer;
+    if (size < 1 || size > 4 || type == GL_BYTE ||
+            !vconvert_lookup(type, 3)) {
+        printf("!!! unsupported new_TexCoordPointer() size %d type 0x%x\n",
+                size, type);
+        p->size = 0;
+        return;
+    }
+    set_pointer(p, size, type, stride, ptr);
+}
+
+void new_ColorPointer( GLint size, GLenum type,
+        GLsizei stride, const GLvoid *ptr )
+{
+    struct vertexpointer_t * p = &recorder()->gl->colorpointer;
+    if (size < 3 || size > 4 || !gl_type_size(type)) {
+        printf("!!! unsupported new_ColorPointer() size %d type 0x%x\n",
+                size, type);
+        p->size = 0;
+        return;
+    }
+    set_pointer(p, size, type, stride, ptr);
+}
+
+/* the formats of glInterleavedArrays(), as in table 2.5 of the */
+/* OpenGL 2.1 spec. offsets and strides are in bytes, texture   */
+/* coordinates are always first. a size of 0 is not present.   */
+struct interleaved_t {
+    GLenum format;
+    int    tsize;
+    int    csize;
+    GLenum ctype;
+    int    nsize;
+    int    vsize;
+    int    coff;
+    int    noff;
+    int    voff;
+    int    stride;
+};
+
+const struct interleaved_t interleaved[] = {
+    /* format           t  c  ctype             n  v  pc  pn  pv  s */
+    { GL_V2F,             0, 0, 0,                0, 2,  0,  0,  0,  8 },
+    { GL_V3F,             0, 0, 0,                0, 3,  0,  0,  0, 12 },
+    { GL_C4UB_V2F,        0, 4, GL_UNSIGNED_BYTE, 0, 2,  0,  0,  4, 12 },
+    { GL_C4UB_V3F,        0, 4, GL_UNSIGNED_BYTE, 0, 3,  0,  0,  4, 16 },
+    { GL_C3F_V3F,         0, 3, GL_FLOAT,         0, 3,  0,  0, 12, 24 },
+    { GL_N3F_V3F,         0, 0, 0,                3, 3,  0,  0, 12, 24 },
+    { GL_C4F_N3F_V3F,     0, 4, GL_FLOAT,         3, 3,  0, 16, 28, 40 },
+    { GL_T2F_V3F,         2, 0, 0,                0, 3,  0,  0,  8, 20 },
+    { GL_T4F_V4F,         4, 0, 0,                0, 4,  0,  0, 16, 32 },
+    { GL_T2F_C4UB_V3F,    2, 4, GL_UNSIGNED_BYTE, 0, 3,  8,  0, 12, 24 },
+    { GL_T2F_C3F_V3F,     2, 3, GL_FLOAT,         0, 3,  8,  0, 20, 32 },
+    { GL_T2F_N3F_V3F,     2, 0, 0,                3, 3,  0,  8, 20, 32 },
+    { GL_T2F_C4F_N3F_V3F, 2, 4, GL_FLOAT,         3, 3,  8, 24, 36, 48 },
+    { GL_T4F_C4F_N3F_V4F, 4, 4, GL_FLOAT,         3, 4, 16, 32, 44, 60 },
+};
+
+/* sets up and enables (or disables) all four arrays at once */
+void new_InterleavedArrays( GLenum format, GLsizei stride,
+        const GLvoid *pointer )
+{
+    struct recorder_t * r = recorder();
+    const struct interleaved_t * f = NULL;
+    const char * base = pointer;
+    int i;
+
+    for (i=0; i<sizeof(interleaved)/sizeof(interleaved[0]); i++)
+        if (interleaved[i].format == format)
+            f = &interleaved[i];
+    if (!f) {
+        printf("!!! unsupported glInterleavedArrays() format 0x%x\n", format);
+        return;
+    }
+    if (!stride)
+        stride = f->stride;
+
+    r->gl->texcoordpointer.enabled = f->tsize != 0;
+    if (f->tsize)
+        set_pointer(&r->gl->texcoordpointer, f->tsize, GL_FLOAT, stride, base);
+    r->gl->colorpointer.enabled = f->csize != 0;
+    if (f->csize)
+        set_pointer(&r->gl->colorpointer, f->csize, f->ctype, stride,
+                base + f->coff);
+    r->gl->normalpointer.enabled = f->nsize != 0;
+    if (f->nsize)
+        set_pointer(&r->gl->normalpointer, 3, GL_FLOAT, stride, base + f->noff);
+    r->gl->vertexpointer.enabled = 1;
+    set_pointer(&r->gl->vertexpointer, f->vsize, GL_FLOAT, stride, base + f->voff);
+}
+
+/* glEnableClientState() / glDisableClientState() */
+void set_client_state(GLenum array, int enabled)
+{
+    struct recorder_t * r = recorder();
+    switch (array) {
+        case GL_VERTEX_ARRAY:
+            r->gl->vertexpointer.enabled = enabled;
+            break;
+        case GL_NORMAL_ARRAY:
+            r->gl->normalpointer.enabled = enabled;
+            break;
+        case GL_TEXTURE_COORD_ARRAY:
+            r->gl->texcoordpointer.enabled = enabled;
+            break;
+        case GL_COLOR_ARRAY:
+            r->gl->colorpointer.enabled = enabled;
+            break;
+    }
+}
+
+/**************************************************************/
+/* capture containers                                         */
+/* with OGLDUMP_FORMAT=frame or capture objects don't get a   */
+/* file each, they're streamed into one container per frame  */
+/* or per trigger, see ogd.h. a container is locked while an  */
+/* object goes in, objects of other frames are written to     */
+/* theirs in parallel. only a few are kept open at a time.    */
+
+enum { FORMAT_STL, FORMAT_FRAME, FORMAT_CAPTURE, FORMAT_OBJ, FORMAT_PLY,
+       FORMAT_RAW, FORMAT_GLTF };
+const char * format_names[] = { "stl", "frame", "capture", "obj", "ply",
+    "raw", "gltf", NULL };
+
+int output_format = FORMAT_STL;
+
+#define CONTAINERS_OPEN_MAX 16
+
+struct container_t {
+    struct container_t  * next;
+    uint32_t              key;      /* frame or trigger number */
+    int                   fd;       /* -1 while closed */
+    int                   users;    /* writers about to use fd */
+    uint64_t              last_use;
+    uint64_t              end;      /* where the next object goes */
+    uint32_t              n_objects;
+    uint32_t              size;     /* of index */
+    struct ogd_object_t * index;
+    pthread_mutex_t       lock;     /* held while an object is written */
+};
+
+struct container_t * containers      = NULL;
+int                  containers_open = 0;
+uint64_t             containers_use  = 0;
+pthread_mutex_t      containers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void container_fname(char * buf, size_t len, uint32_t key)
+{
+    snprintf(buf, len, "%s/%s_%.7u" OGD_SUFFIX, FNAME_PREFIX,
+            format_names[output_format], key);
+}
+
+int container_header(struct container_t * c, uint64_t index_offset)
+{
+    struct ogd_header_t h;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, OGD_MAGIC, sizeof(OGD_MAGIC));
+    h.version      = OGD_VERSION;
+    h.n_objects    = c->n_objects;
+    h.index_offset = index_offset;
+    if (pwrite(c->fd, &h, sizeof(h), 0) != sizeof(h)) {
+        printf("!!! couldn't write container header: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* close the one used longest ago, with containers_lock held */
+void container_evict(void)
+{
+    struct container_t * c, * lru = NULL;
+
+    for (c = containers; c; c = c->next)
+        if (c->fd >= 0 && !c->users && (!lru || c->last_use < lru->last_use))
+            lru = c;
+    if (lru) {
+        close(lru->fd);
+        lru->fd = -1;
+        containers_open--;
+    }
+}
+
+/* the container for key, locked for one object. NULL on failure */
+struct container_t * container_get(uint32_t key)
+{
+    char fname[256];
+    struct container_t * c;
+
+    pthread_mutex_lock(&containers_lock);
+    for (c = containers; c; c = c->next)
+        if (c->key == key)
+            break;
+    if (!c) {
+        c = calloc(1, sizeof(*c));
+        if (!c) enomem();
+        c->key = key;
+        c->end = sizeof(struct ogd_header_t);
+        pthread_mutex_init(&c->lock, NULL);
+        container_fname(fname, sizeof(fname), key);
+        c->fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (c->fd < 0 || container_header(c, 0)) {
+            printf("!!! couldn't create container %s: %s\n", fname, strerror(errno));
+            if (c->fd >= 0)
+                close(c->fd);
+            free(c);
+            pthread_mutex_unlock(&containers_lock);
+            return NULL;
+        }
+        c->next    = containers;
+        containers = c;
+        containers_open++;
+    } else if (c->fd < 0) {
+        container_fname(fname, sizeof(fname), key);
+        c->fd = open(fname, O_WRONLY);
+        if (c->fd < 0) {
+            printf("!!! couldn't reopen container %s: %s\n", fname, strerror(errno));
+            pthread_mutex_unlock(&containers_lock);
+            return NULL;
+        }
+        containers_open++;
+    }
+    c->users++;
+    c->last_use = ++containers_use;
+    if (containers_open > CONTAINERS_OPEN_MAX)
+        container_evict();
+    pthread_mutex_unlock(&containers_lock);
+
+    pthread_mutex_lock(&c->lock);
+    return c;
+}
+
+/* the object of n_triangles at c->end is complete, unlock c */
+void container_put(struct container_t * c, const char * name,
+        uint32_t frame, uint32_t n_triangles)
+{
+    struct ogd_object_t * o;
+
+    if (c->n_objects == c->size) {
+        c->size  = c->size ? 2 * c->size : 256;
+        c->index = realloc(c->index, c->size * sizeof(*c->index));
+        if (!c->index) enomem();
+    }
+    o = &c->index[c->n_objects++];
+    memset(o, 0, sizeof(*o));
+    snprintf(o->name, OGD_NAME_LEN, "%s", name);
+    o->offset      = c->end;
+    o->n_triangles = n_triangles;
+    o->frame       = frame;
+    c->end += 84 + STL_RECORD_SIZE * (uint64_t) n_triangles;
+    pthread_mutex_unlock(&c->lock);
+
+    pthread_mutex_lock(&containers_lock);
+    c->users--;
+    pthread_mutex_unlock(&containers_lock);
+}
+
+/* write the indices, only once all writers are done */
+void containers_close(void)
+{
+    char fname[256];
+    struct container_t * c, * next;
+    size_t len;
+
+    for (c = containers; c; c = next) {
+        next = c->next;
+        container_fname(fname, sizeof(fname), c->key);
+        if (c->fd < 0)
+            c->fd = open(fname, O_WRONLY);
+        len = c->n_objects * sizeof(*c->index);
+        if (c->fd < 0 || pwrite(c->fd, c->index, len, c->end) != len ||
+                container_header(c, c->end))
+            printf("!!! couldn't write index of %s: %s\n", fname, strerror(errno));
+        else
+            printf("+++ %s has %u objects\n", fname, c->n_objects);
+        if (c->fd >= 0)
+            close(c->fd);
+        free(c->index);
+        free(c);
+    }
+    containers      = NULL;
+    containers_open = 0;
+}
+
+/**************************************************************/
+/* processing opengl primitives to STL normals and triangles */
+
+/* buffered STL writer: the 50 byte records are packed into a large */
+/* buffer which goes to the file in big write()s. the triangle count */
+/* in the header is written up front when it is known in advance.    */
+/* OBJ and PLY files and glTF meshes are written from the same      */
+/* records, converted whenever the buffer is flushed.                */
+
+#define STL_WBUF_SIZE   (STL_RECORD_SIZE * 20480) /* ~1MB */
+#define STL_COUNT_UNKNOWN 0xffffffff
+
+struct stl_writer_t {
+    int        fd;
+    uint64_t   base;        /* of the STL in fd, 0 but in containers */
+    uint64_t   pos;         /* bytes written after base so far */
+    uint32_t   n_triangles; /* triangles written so far */
+    uint32_t   n_header;    /* triangle count we put in the header */
+    size_t     used;
+    size_t     first;       /* offset of the 1st record in buf */
+    int        face_normals; /* compute all normals when flushing */
+    int        format;       /* FORMAT_STL, FORMAT_OBJ, _PLY or _GLTF */
+    char     * buf;
+    float      min[3];       /* bounds of the vertices, for glTF */
+    float      max[3];
+
+    struct container_t * cont; /* NULL for a file of its own */
+    char       name[OGD_NAME_LEN];
+    uint32_t   frame;
+};
+
+/* len bytes at the current position */
+int stl_write(struct stl_writer_t * w, const char * p, size_t left)
+{
+    while (left) {
+        ssize_t ret = pwrite(w->fd, p, left, w->base + w->pos);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            printf("!!! couldn't write %s data: %s\n",
+                    format_names[w->format], strerror(errno));
+            return -1;
+        }
+        p      += ret;
+        left   -= ret;
+        w->pos += ret;
+    }
+    return 0;
+}
+
+#define MESH_WBUF_SIZE (1024 * 1024)
+#define PLY_HEADER \
+    "ply\n" \
+    "format binary_little_endian 1.0\n" \
+    "comment ogldump\n" \
+    "element vertex %010u\n" \
+    "property float x\n" \
+    "property float y\n" \
+    "property float z\n" \
+    "property float nx\n" \
+    "property float ny\n" \
+    "property float nz\n" \
+    "element face %010u\n" \
+    "property list uchar int vertex_indices\n" \
+    "end_header\n"
+
+/* OBJ text or PLY vertices of n records. every triangle gets */
+/* vertices of its own, with the face normal.                 */
+int mesh_write(struct stl_writer_t * w, const char * r, size_t n)
+{
+    static __thread char * out = NULL;
+    size_t used = 0;
+    float t[12];
+    int i;
+
+    if (!out) {
+        out = malloc(MESH_WBUF_SIZE);
+        if (!out) enomem();
+    }
+    for (; n; n--, r += STL_RECORD_SIZE) {
+        if (used + 512 > MESH_WBUF_SIZE) {
+            if (stl_write(w, out, used))
+                return -1;
+            used = 0;
+        }
+        memcpy(t, r, 48);
+        if (w->format == FORMAT_OBJ) {
+            used += sprintf(out + used, "vn %.9g %.9g %.9g\n", t[0], t[1], t[2]);
+            for (i=1; i<4; i++)
+                used += sprintf(out + used, "v %.9g %.9g %.9g\n",
+                        t[3*i], t[3*i + 1], t[3*i + 2]);
+            used += sprintf(out + used, "f -3//-1 -2//-1 -1//-1\n");
+        } else {
+            /* PLY and glTF take the same vertices */
+            for (i=1; i<4; i++) {
+                memcpy(out + used,      &t[3*i], 12);
+                memcpy(out + used + 12, t,       12);
+                used += 24;
+            }
+            if (w->format == FORMAT_GLTF)
+                for (i=3; i<12; i++) {
+                    if (t[i] < w->min[i % 3])
+                        w->min[i % 3] = t[i];
+                    if (t[i] > w->max[i % 3])
+                        w->max[i % 3] = t[i];
+                }
+        }
+    }
+    return stl_write(w, out, used);
+}
+
+/* PLY wants the faces after all vertices, and the counts */
+/* in the header. it was written with room for them.      */
+int ply_finish(struct stl_writer_t * w)
+{
+    char header[sizeof(PLY_HEADER) + 32];
+    uint32_t i, n = w->n_triangles;
+    int32_t idx;
+    int len;
+
+    for (i=0; i<n; i++) {
+        char * f;
+        if (w->used + 13 > STL_WBUF_SIZE) {
+            if (stl_write(w, w->buf, w->used))
+                return -1;
+            w->used = 0;
+        }
+        f = w->buf + w->used;
+        f[0] = 3;
+        idx = 3 * i;     memcpy(f + 1, &idx, 4);
+        idx = 3 * i + 1; memcpy(f + 5, &idx, 4);
+        idx = 3 * i + 2; memcpy(f + 9, &idx, 4);
+        w->used += 13;
+    }
+    if (stl_write(w, w->buf, w->used))
+        return -1;
+    w->used = 0;
+
+    len = sprintf(header, PLY_HEADER, 3 * n, n);
+    if (pwrite(w->fd, header, len, w->base) != len) {
+        printf("!!! couldn't fix up PLY header: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int stl_flush(struct stl_writer_t * w)
+{
+    int ret;
+
+    if (w->face_normals)
+        stl_face_normals(w->buf + w->first,
+                (w->used - w->first) / STL_RECORD_SIZE, 1);
+
+    if (w->format == FORMAT_STL) {
+        ret = stl_write(w, w->buf, w->used);
+    } else {
+        /* the header, then the records converted */
+        ret = stl_write(w, w->buf, w->first);
+        if (!ret)
+            ret = mesh_write(w, w->buf + w->first,
+                    (w->used - w->first) / STL_RECORD_SIZE);
+    }
+    w->first = 0;
+    w->used  = 0;
+    return ret;
+}
+
+/* w->fd, base, cont, name and format are set up by the caller */
+void stl_begin(struct stl_writer_t * w, uint32_t n_triangles)
+{
+    static __thread char * buf = NULL; /* one per writer thread */
+
+    if (!buf) {
+        buf = malloc(STL_WBUF_SIZE);
+        if (!buf) enomem();
+    }
+    w->buf         = buf;
+    w->pos         = 0;
+    w->n_triangles = 0;
+    w->n_header    = n_triangles;
+    w->face_normals = 0;
+
+    switch (w->format) {
+        case FORMAT_OBJ:
+            w->used = sprintf(w->buf, "# ogldump\no %s\n", w->name);
+            break;
+        case FORMAT_PLY:
+            w->used = sprintf(w->buf, PLY_HEADER, 0, 0);
+            break;
+        case FORMAT_GLTF:
+            w->used = 0; /* the vertices only, see gltf_finish() */
+            w->min[0] = w->min[1] = w->min[2] =  HUGE_VALF;
+            w->max[0] = w->max[1] = w->max[2] = -HUGE_VALF;
+            break;
+        default:
+            memcpy(w->buf, stl_header, 80);
+            uint32_t count = n_triangles == STL_COUNT_UNKNOWN ? 0 : n_triangles;
+            memcpy(w->buf + 80, &count, 4);
+            w->used = 84;
+            break;
+    }
+    w->first = w->used;
+}
+
+/* an object as a file of its own or into its container, */
+/* depending on OGLDUMP_FORMAT                            */
+int stl_open_object(struct stl_writer_t * w, const char * name,
+        uint32_t frame, uint32_t capture, uint32_t n_triangles)
+{
+    char fname[256];
+    struct container_t * c;
+
+    snprintf(w->name, sizeof(w->name), "%s", name);
+    w->frame = frame;
+    if (output_format == FORMAT_FRAME || output_format == FORMAT_CAPTURE) {
+        c = container_get(output_format == FORMAT_FRAME ? frame : capture);
+        if (!c)
+            return -1;
+        w->fd     = c->fd;
+        w->base   = c->end;
+        w->cont   = c;
+        w->format = FORMAT_STL;
+    } else {
+        snprintf(fname, sizeof(fname), "%s/%s.%s", FNAME_PREFIX, name,
+                format_names[output_format]);
+        w->fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (w->fd < 0) {
+            printf("!!! couldn't open(%s): %s\n", fname, strerror(errno));
+            return -1;
+        }
+        w->base   = 0;
+        w->cont   = NULL;
+        w->format = output_format;
+    }
+    stl_begin(w, n_triangles);
+    return 0;
+}
+
+static inline void stl_triangle(struct stl_writer_t * w, const float * n,
+        const float * a, const float * b, const float * c)
+{
+    char * r;
+
+    if (w->used + STL_RECORD_SIZE > STL_WBUF_SIZE)
+        stl_flush(w);
+
+    r = w->buf + w->used;
+    memcpy(r +  0, n, 12);
+    memcpy(r + 12, a, 12);
+    memcpy(r + 24, b, 12);
+    memcpy(r + 36, c, 12);
+    r[48] = 0; /* unused attribute bytes */
+    r[49] = 0;
+    w->used += STL_RECORD_SIZE;
+    w->n_triangles++;
+}
+
+/* returns the number of triangles written */
+uint32_t stl_close(struct stl_writer_t * w)
+{
+    stl_flush(w);
+    if (w->format == FORMAT_PLY) {
+        ply_finish(w);
+    } else if (w->format == FORMAT_STL && w->n_triangles != w->n_header) {
+        /* the header was a guess, patch the real count in */
+        if (pwrite(w->fd, &w->n_triangles, 4, w->base + 80) != 4)
+            printf("!!! couldn't fix up STL triangle count: %s\n",
+                    strerror(errno));
+    }
+    if (w->cont)
+        container_put(w->cont, w->name, w->frame, w->n_triangles);
+    else
+        close(w->fd);
+    w->fd = -1;
+    return w->n_triangles;
+}
+
+/* number of triangles a primitive of n vertices decomposes into */
+uint32_t gl_triangle_count(GLenum type, uint32_t n)
+{
+    switch (type) {
+        case GL_TRIANGLES:
+            return n / 3;
+        case GL_QUADS:
+            return (n / 4) * 2;
+        case GL_QUAD_STRIP:
+            return n < 4 ? 0 : ((n - 2) / 2) * 2;
+        case GL_TRIANGLE_STRIP:
+        case GL_TRIANGLE_FAN:
+        case GL_POLYGON:
+            return n < 3 ? 0 : n - 2;
+        default:
+            return 0;
+    }
+}
+
+/* n packed x,y,z points in place to world space by the modelview m */
+void transform_points(float * v, uint32_t n, const float * m)
+{
+    uint32_t i;
+#ifdef __SSE__
+    __m128 c0 = _mm_loadu_ps(m);
+    __m128 c1 = _mm_loadu_ps(m + 4);
+    __m128 c2 = _mm_loadu_ps(m + 8);
+    __m128 c3 = _mm_loadu_ps(m + 12);
+
+    for (i=0; i<n; i++, v+=3) {
+        __m128 r = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(v[0])),
+                           _mm_mul_ps(c1, _mm_set1_ps(v[1]))),
+                _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(v[2])), c3));
+        /* only x,y,z are stored, the next point follows right after */
+        _mm_storel_pi((__m64 *) v, r);
+        _mm_store_ss(v + 2, _mm_movehl_ps(r, r));
+    }
+#else
+    for (i=0; i<n; i++, v+=3) {
+        float x = v[0], y = v[1], z = v[2];
+        v[0] = m[0] * x + m[4] * y + m[8]  * z + m[12];
+        v[1] = m[1] * x + m[5] * y + m[9]  * z + m[13];
+        v[2] = m[2] * x + m[6] * y + m[10] * z + m[14];
+    }
+#endif
+}
+
+/* normals go by the inverse transpose of the upper 3x3 of m. */
+/* its cofactor matrix is the same up to a scale, and they're */
+/* renormalized anyway. only the sign of the det is needed.    */
+void transform_normals(float * nv, uint32_t n, const float * m)
+{
+    float c[9];
+    uint32_t i;
+
+    c[0] = m[5] * m[10] - m[9] * m[6];
+    c[1] = m[8] * m[6]  - m[4] * m[10];
+    c[2] = m[4] * m[9]  - m[8] * m[5];
+    c[3] = m[9] * m[2]  - m[1] * m[10];
+    c[4] = m[0] * m[10] - m[8] * m[2];
+    c[5] = m[8] * m[1]  - m[0] * m[9];
+    c[6] = m[1] * m[6]  - m[5] * m[2];
+    c[7] = m[4] * m[2]  - m[0] * m[6];
+    c[8] = m[0] * m[5]  - m[4] * m[1];
+    if (m[0] * c[0] + m[1] * c[1] + m[2] * c[2] < 0.0f)
+        for (i=0; i<9; i++)
+            c[i] = -c[i];
+
+    for (i=0; i<n; i++, nv+=3) {
+        float x = nv[0], y = nv[1], z = nv[2];
+        float tx = c[0] * x + c[3] * y + c[6] * z;
+        float ty = c[1] * x + c[4] * y + c[7] * z;
+        float tz = c[2] * x + c[5] * y + c[8] * z;
+        float len = sqrtf(tx * tx + ty * ty + tz * tz);
+        if (len > 0.0f) {
+            tx /= len;
+            ty /= len;
+            tz /= len;
+        }
+        nv[0] = tx;
+        nv[1] = ty;
+        nv[2] = tz;
+    }
+}
+
+/* how a triangle gets its normal */
+enum {
+    NORMAL_PROVOKING, /* of one of its vertices, as set by glNormal*() */
+    NORMAL_AVERAGE,   /* average of the normals of its vertices */
+    NORMAL_GEOMETRY,  /* computed from its vertices */
+};
+
+/* where the vertices of a prim or an array draw are read from */
+struct vsource_t {
+    const float * v;       /* positions */
+    const float * n;       /* normals, unused for NORMAL_GEOMETRY */
+    int           normals; /* one of NORMAL_* */
+    uint32_t      vstride; /* in floats */
+    uint32_t      nstride; /* in floats */
+    const void  * indices; /* NULL for consecutive vertices */
+    GLenum        type;    /* of indices */
+    uint32_t      base;    /* subtracted from every index */
+};
+
+static inline uint32_t vsource_index(const struct vsource_t * s, uint32_t i)
+{
+    switch (s->type) {
+        case GL_UNSIGNED_BYTE:
+            return ((const uint8_t *) s->indices)[i] - s->base;
+        case GL_UNSIGNED_SHORT:
+            return ((const uint16_t *) s->indices)[i] - s->base;
+        case GL_UNSIGNED_INT:
+            return ((const uint32_t *) s->indices)[i] - s->base;
+        default:
+            return i;
+    }
+}
+
+/* a, b, c and the vertex providing the normal are counted in */
+/* the order the vertices were submitted                       */
+static inline void vsource_triangle(struct stl_writer_t * w,
+        const struct vsource_t * s,
+        uint32_t a, uint32_t b, uint32_t c, uint32_t normal)
+{
+    a = vsource_index(s, a);
+    b = vsource_index(s, b);
+    c = vsource_index(s, c);
+    const float * va = &s->v[s->vstride * a];
+    const float * vb = &s->v[s->vstride * b];
+    const float * vc = &s->v[s->vstride * c];
+    static const float zero[3] = { 0.0f, 0.0f, 0.0f };
+    float n[3];
+
+    switch (s->normals) {
+        case NORMAL_PROVOKING:
+            stl_triangle(w, &s->n[s->nstride * vsource_index(s, normal)],
+                    va, vb, vc);
+            return;
+        case NORMAL_AVERAGE:
+            {
+                const float * na = &s->n[s->nstride * a];
+                const float * nb = &s->n[s->nstride * b];
+                const float * nc = &s->n[s->nstride * c];
+                n[0] = na[0] + nb[0] + nc[0];
+                n[1] = na[1] + nb[1] + nc[1];
+                n[2] = na[2] + nb[2] + nc[2];
+                if (n[0] != 0.0f || n[1] != 0.0f || n[2] != 0.0f)
+                    break;
+            }
+            /* opposing normals, use the geometry of this one */
+            {
+                float u[3] = { vb[0] - va[0], vb[1] - va[1], vb[2] - va[2] };
+                float v[3] = { vc[0] - va[0], vc[1] - va[1], vc[2] - va[2] };
+                n[0] = u[1] * v[2] - u[2] * v[1];
+                n[1] = u[2] * v[0] - u[0] * v[2];
+                n[2] = u[0] * v[1] - u[1] * v[0];
+                break;
+            }
+        case NORMAL_GEOMETRY:
+        default:
+            /* filled in by stl_flush(), a buffer at a time */
+            stl_triangle(w, zero, va, vb, vc);
+            return;
+    }
+
+    float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len > 0.0f) {
+        n[0] /= len;
+        n[1] /= len;
+        n[2] /= len;
+    }
+    stl_triangle(w, n, va, vb, vc);
+}
+
+/* primitive assembly, shared by glBegin()/glEnd() prims and   */
+/* array draws: decompose count vertices of the given mode     */
+/* into triangles. returns the number of triangles written.    */
+uint32_t assemble(struct stl_writer_t * w, GLenum mode, uint32_t count,
+        const struct vsource_t * s)
+{
+    uint32_t i;
+
+    switch (mode) {
+        case GL_TRIANGLES:
+            for (i=0; i+2 < count; i+=3)
+                vsource_triangle(w, s, i, i+1, i+2, i);
+            break;
+        case GL_TRIANGLE_STRIP:
+            /* every other triangle is flipped to keep the winding */
+            for (i=0; i+2 < count; i++) {
+                if (i & 1)
+                    vsource_triangle(w, s, i+1, i, i+2, i+2);
+                else
+                    vsource_triangle(w, s, i, i+1, i+2, i+2);
+            }
+            break;
+        case GL_TRIANGLE_FAN:
+        case GL_POLYGON: /* convex, so it's a fan, too */
+            for (i=1; i+1 < count; i++)
+                vsource_triangle(w, s, 0, i, i+1, i+1);
+            break;
+        case GL_QUADS:
+            for (i=0; i+3 < count; i+=4) {
+                vsource_triangle(w, s, i, i+1, i+2, i);
+                vsource_triangle(w, s, i, i+2, i+3, i);
+            }
+            break;
+        case GL_QUAD_STRIP:
+            /* quad k is made of the vertices 2k, 2k+1, 2k+3, 2k+2 */
+            for (i=0; i+3 < count; i+=2) {
+                vsource_triangle(w, s, i, i+1, i+3, i+3);
+                vsource_triangle(w, s, i, i+3, i+2, i+3);
+            }
+            break;
+        default:
+            printf("!!! FIXME implement gl_primitive type 0x%4.4x / %s\n",
+                    mode, prim_name(mode));
+            return 0;
+    }
+    return gl_triangle_count(mode, count);
+}
+
+/* 1 if the object was written */
+int switch_gl_primitive(int n, struct capture_t * c, struct prim_t * prim)
+{
+    char name[OGD_NAME_LEN];
+    struct stl_writer_t w;
+    sprintf(name, "prim_%.7d", n);
+    if (stl_open_object(&w, name, prim->frame, prim->capture,
+                gl_triangle_count(prim->type, prim->nV3)))
+        return 0;
+
+    /* in place, every prim is exported once */
+    if (prim->modelview) {
+        transform_points(&c->vstore.v[3 * prim->first], prim->nV3, prim->modelview);
+        transform_normals(&c->vstore.n[3 * prim->first], prim->nV3, prim->modelview);
+    }
+
+    struct vsource_t s = {
+        .v       = &c->vstore.v[3 * prim->first],
+        .n       = &c->vstore.n[3 * prim->first],
+        .normals = NORMAL_PROVOKING,
+        .vstride = 3,
+        .nstride = 3,
+    };
+    assemble(&w, prim->type, prim->nV3, &s);
+    stl_close(&w);
+    return 1;
+}
+
+/* conversion buffers of an export, reused for all of its objects. */
+/* copies in the capture are shared, they're never converted in    */
+/* place.                                                           */
+struct convbuf_t {
+    float    * v;
+    float    * n;
+    uint32_t   size; /* in vertices */
+};
+
+void convbuf_grow(struct convbuf_t * b, uint32_t nv)
+{
+    if (nv <= b->size)
+        return;
+    free(b->v);
+    free(b->n);
+    b->v = malloc((size_t) nv * 3 * sizeof(float));
+    b->n = malloc((size_t) nv * 3 * sizeof(float));
+    if (!b->v || !b->n) enomem();
+    b->size = nv;
+}
+
+/* the vertices and normals of d as x,y,z floats in b, transformed */
+/* by m unless it's NULL. returns the number of vertices.         */
+uint32_t draw_convert(struct convbuf_t * b, struct drawelements_t * d,
+        const float * m)
+{
+    uint32_t nv = d->vertexpointer.max_index - d->vertexpointer.min_index + 1;
+
+    convbuf_grow(b, nv);
+    vconvert(b->v, &d->vertexpointer);
+    if (d->normalpointer.size)
+        vconvert(b->n, &d->normalpointer);
+    if (m) {
+        transform_points(b->v, nv, m);
+        if (d->normalpointer.size)
+            transform_normals(b->n, nv, m);
+    }
+    return nv;
+}
+
+/* geometric normals are computed a buffer at a time, by stl_flush() */
+static inline void stl_face_normals_on(struct stl_writer_t * w, int on)
+{
+    if (w->face_normals != on) {
+        if (w->used > w->first)
+            stl_flush(w);
+        w->face_normals = on;
+    }
+}
+
+/* v3 holds the vertices of d converted to x,y,z floats, */
+/* n3 the normals if d has any                            */
+uint32_t assemble_draw(struct stl_writer_t * w, struct drawelements_t * d,
+        const float * v3, const float * n3)
+{
+    struct vsource_t s = {
+        .v       = v3,
+        .n       = n3,
+        .normals = d->normalpointer.size ? NORMAL_AVERAGE : NORMAL_GEOMETRY,
+        .vstride = 3,
+        .nstride = 3,
+        .indices = d->indices,
+        .type    = d->type,
+        .base    = d->vertexpointer.min_index,
+    };
+    stl_face_normals_on(w, s.normals == NORMAL_GEOMETRY);
+    return assemble(w, d->mode, d->count, &s);
+}
+
+/* 1 if the object was written */
+int do_file_DrawElements(int n, struct drawelements_t * p,
+        const float * v3, const float * n3)
+{
+    char name[OGD_NAME_LEN];
+    struct stl_writer_t w;
+    sprintf(name, "drawelements_%.7d", n);
+    if (stl_open_object(&w, name, p->frame, p->capture,
+                gl_triangle_count(p->mode, p->count)))
+        return 0;
+
+    assemble_draw(&w, p, v3, n3);
+
+    printf("+++ drawelement %d has %d triangles\n", n, stl_close(&w));
+    return 1;
+}
+
+/* a list call is one object, made of everything the list and the */
+/* lists it calls draw                                            */
+
+/* the product a * b into m, NULL stands for the identity */
+const float * mat_compose(float * m, const float * a, const float * b)
+{
+    if (!a || !b)
+        return a ? a : b;
+    memcpy(m, a, 16 * sizeof(float));
+    mat_mul(m, b);
+    return m;
+}
+
+/* the matrix of an object of a list called with a */
+static inline const float * list_compose(float * m, const float * a,
+        const float * b, int absolute)
+{
+    return absolute ? b : mat_compose(m, a, b);
+}
+
+uint32_t list_triangle_count(struct dlist_t * l, int depth)
+{
+    struct prim_t * p;
+    struct drawelements_t * d;
+    struct listcall_t * call;
+    uint32_t n = 0;
+
+    if (depth >= DLIST_NESTING_MAX)
+        return 0;
+    for (p = l->cap->all_prims; p; p = p->next)
+        n += gl_triangle_count(p->type, p->nV3);
+    for (d = l->cap->all_drawelements; d; d = d->next)
+        n += gl_triangle_count(d->mode, d->count);
+    for (call = l->cap->all_listcalls; call; call = call->next)
+        n += list_triangle_count(call->list, depth + 1);
+    return n;
+}
+
+/* everything l draws, transformed by m */
+void list_export(struct stl_writer_t * w, struct dlist_t * l,
+        const float * m, struct convbuf_t * b, int depth)
+{
+    struct capture_t * c = l->cap;
+    struct prim_t * p;
+    struct drawelements_t * d;
+    struct listcall_t * call;
+    const float * t;
+    float mv[16];
+
+    if (depth >= DLIST_NESTING_MAX)
+        return;
+
+    for (p = c->all_prims; p; p = p->next) {
+        convbuf_grow(b, p->nV3);
+        memcpy(b->v, &c->vstore.v[3 * p->first], 3 * sizeof(float) * p->nV3);
+        memcpy(b->n, &c->vstore.n[3 * p->first], 3 * sizeof(float) * p->nV3);
+        if ((t = list_compose(mv, m, p->modelview, p->absolute))) {
+            transform_points(b->v, p->nV3, t);
+            transform_normals(b->n, p->nV3, t);
+        }
+        struct vsource_t s = {
+            .v       = b->v,
+            .n       = b->n,
+            .normals = NORMAL_PROVOKING,
+            .vstride = 3,
+            .nstride = 3,
+        };
+        stl_face_normals_on(w, 0);
+        assemble(w, p->type, p->nV3, &s);
+    }
+
+    for (d = c->all_drawelements; d; d = d->next) {
+        draw_convert(b, d, list_compose(mv, m, d->modelview, d->absolute));
+        assemble_draw(w, d, b->v, b->n);
+    }
+
+    for (call = c->all_listcalls; call; call = call->next)
+        list_export(w, call->list,
+                list_compose(mv, m, call->modelview, call->absolute),
+                b, depth + 1);
+}
+
+/**************************************************************/
+/* raw capture stream                                         */
+/* with OGLDUMP_FORMAT=raw an export only serializes the      */
+/* capture as it was recorded, see ogr.h. the conversion is   */
+/* left to ogldump_convert, on this machine or another one.   */
+
+#define RAW_CHUNK_SIZE (1024 * 1024)
+
+uint32_t        raw_compress = 0;  /* zlib level, 0 stores chunks as is */
+int             raw_fd       = -1; /* opened with the first chunk */
+uint64_t        raw_bytes    = 0;
+uint32_t        raw_segments = 0;
+pthread_mutex_t raw_lock     = PTHREAD_MUTEX_INITIALIZER;
+
+struct raw_writer_t {
+    uint32_t      segment;
+    uint32_t      blobs;   /* ids handed out so far */
+    uint32_t      lists;
+    size_t        used;
+    size_t        size;
+    char        * buf;
+    /* ids of the blobs and lists written to the segment, by address. */
+    /* lists are shared by captures, so the ids can't go into them.   */
+    const void ** ids_key;
+    uint32_t    * ids_val;  /* id + 1 */
+    uint32_t      ids_size; /* a power of 2 */
+    uint32_t      ids_used;
+};
+
+int raw_write(const void * data, size_t left)
+{
+    const char * p = data;
+
+    while (left) {
+        ssize_t ret = write(raw_fd, p, left);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            printf("!!! couldn't write raw stream: %s\n", strerror(errno));
+            return -1;
+        }
+        p    += ret;
+        left -= ret;
+    }
+    return 0;
+}
+
+/* with raw_lock held */
+int raw_open(void)
+{
+    char fname[256];
+    struct ogr_header_t h;
+
+    snprintf(fname, sizeof(fname), "%s/" OGR_FNAME, FNAME_PREFIX);
+    raw_fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (raw_fd < 0) {
+        printf("!!! couldn't open(%s): %s\n", fname, strerror(errno));
+        return -1;
+    }
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, OGR_MAGIC, sizeof(OGR_MAGIC));
+    h.version = OGR_VERSION;
+    raw_bytes = sizeof(h);
+    return raw_write(&h, sizeof(h));
+}
+
+/* compress and append the records gathered so far */
+void raw_chunk(struct raw_writer_t * w)
+{
+    static __thread Bytef * zbuf  = NULL;
+    static __thread uLong   zsize = 0;
+    struct ogr_chunk_t ch;
+    const void * data = w->buf;
+
+    if (!w->used)
+        return;
+    ch.segment = w->segment;
+    ch.codec   = OGR_STORED;
+    ch.raw_len = w->used;
+    ch.len     = w->used;
+    if (raw_compress) {
+        uLongf len = compressBound(w->used);
+        if (len > zsize) {
+            zbuf = realloc(zbuf, len);
+            if (!zbuf) enomem();
+            zsize = len;
+        }
+        if (compress2(zbuf, &len, (Bytef *) w->buf, w->used, raw_compress) == Z_OK &&
+                len < w->used) {
+            ch.codec = OGR_ZLIB;
+            ch.len   = len;
+            data     = zbuf;
+        }
+    }
+    w->used = 0;
+
+    pthread_mutex_lock(&raw_lock);
+    if (raw_fd < 0 && raw_open() < 0) {
+        pthread_mutex_unlock(&raw_lock);
+        return;
+    }
+    if (!raw_write(&ch, sizeof(ch)) && !raw_write(data, ch.len))
+        raw_bytes += sizeof(ch) + ch.len;
+    pthread_mutex_unlock(&raw_lock);
+}
+
+/* room for a record of len bytes, to be filled in right away */
+void * raw_record(struct raw_writer_t * w, uint32_t type, size_t len)
+{
+    struct ogr_rec_t rec = { type, len };
+    size_t need = sizeof(rec) + len;
+    char * p;
+
+    if (w->used && w->used + need > RAW_CHUNK_SIZE)
+        raw_chunk(w);
+    if (w->used + need > w->size) {
+        w->size = need > RAW_CHUNK_SIZE ? need : RAW_CHUNK_SIZE;
+        w->buf  = realloc(w->buf, w->size);
+        if (!w->buf) enomem();
+    }
+    p = w->buf + w->used;
+    memcpy(p, &rec, sizeof(rec));
+    w->used += need;
+    return p + sizeof(rec);
+}
+
+/* the id of p + 1 in this segment, 0 until one is set. the */
+/* pointer is valid until the next call.                     */
+uint32_t * raw_id(struct raw_writer_t * w, const void * p)
+{
+    uint32_t i, mask;
+
+    if (2 * (w->ids_used + 1) > w->ids_size) {
+        struct raw_writer_t old = *w;
+        w->ids_size = old.ids_size ? 2 * old.ids_size : 1024;
+        w->ids_key  = calloc(w->ids_size, sizeof(*w->ids_key));
+        w->ids_val  = malloc(w->ids_size * sizeof(*w->ids_val));
+        if (!w->ids_key || !w->ids_val) enomem();
+        w->ids_used = 0;
+        for (i=0; i<old.ids_size; i++)
+            if (old.ids_key[i])
+                *raw_id(w, old.ids_key[i]) = old.ids_val[i];
+        free(old.ids_key);
+        free(old.ids_val);
+    }
+    mask = w->ids_size - 1;
+    i = (uint32_t) (((uintptr_t) p >> 4) * 0x9e3779b97f4a7c15ULL >> 32) & mask;
+    while (w->ids_key[i] && w->ids_key[i] != p)
+        i = (i + 1) & mask;
+    if (!w->ids_key[i]) {
+        w->ids_key[i] = p;
+        w->ids_val[i] = 0;
+        w->ids_used++;
+    }
+    return &w->ids_val[i];
+}
+
+/* id of the copy p, the blob goes into the stream on first use */
+uint32_t raw_blob(struct raw_writer_t * w, const void * p)
+{
+    struct blob_t * b;
+    uint32_t * slot;
+    char * r;
+    uint32_t id;
+
+    if (!p)
+        return OGR_NO_BLOB;
+    slot = raw_id(w, p);
+    if (*slot)
+        return *slot - 1;
+    id    = w->blobs++;
+    *slot = id + 1;
+    b = blob_of(p);
+    r = raw_record(w, OGR_BLOB, 4 + b->len);
+    memcpy(r, &id, 4);
+    memcpy(r + 4, p, b->len);
+    return id;
+}
+
+void raw_array(struct raw_writer_t * w, struct ogr_array_t * a,
+        struct vertexpointer_t * v)
+{
+    a->size        = v->ptr_copy ? v->size : 0;
+    a->type        = v->type;
+    a->stride      = v->stride;
+    a->sizeof_type = v->sizeof_type;
+    a->min_index   = v->min_index;
+    a->max_index   = v->max_index;
+    a->blob        = raw_blob(w, a->size ? v->ptr_copy : NULL);
+}
+
+uint32_t raw_list(struct raw_writer_t * w, struct dlist_t * l);
+
+static inline uint32_t ogr_modelview(const float * m, int absolute)
+{
+    return (m ? OGR_MODELVIEW : 0) | (absolute ? OGR_MODELVIEW_ABSOLUTE : 0);
+}
+
+/* the records of everything c holds */
+void raw_capture(struct raw_writer_t * w, struct capture_t * c)
+{
+    struct prim_t * p;
+    struct drawelements_t * d;
+    struct listcall_t * call;
+    char * r;
+
+    for (p = c->all_prims; p; p = p->next) {
+        struct ogr_prim_t op = {
+            .n         = p->n,
+            .frame     = p->frame,
+            .capture   = p->capture,
+            .type      = p->type,
+            .nV3       = p->nV3,
+            .modelview = ogr_modelview(p->modelview, p->absolute),
+        };
+        size_t mv = p->modelview ? 16 * sizeof(float) : 0;
+        size_t vn = 3 * sizeof(float) * p->nV3;
+
+        r = raw_record(w, OGR_PRIM, sizeof(op) + mv + 2 * vn);
+        memcpy(r, &op, sizeof(op));
+        r += sizeof(op);
+        if (mv)
+            memcpy(r, p->modelview, mv);
+        memcpy(r + mv,      &c->vstore.v[3 * p->first], vn);
+        memcpy(r + mv + vn, &c->vstore.n[3 * p->first], vn);
+    }
+
+    for (d = c->all_drawelements; d; d = d->next) {
+        struct ogr_draw_t od = {
+            .n           = d->n,
+            .frame       = d->frame,
+            .capture     = d->capture,
+            .mode        = d->mode,
+            .count       = d->count,
+            .type        = d->type,
+            .sizeof_type = d->sizeof_type,
+            .modelview   = ogr_modelview(d->modelview, d->absolute),
+        };
+        size_t mv = d->modelview ? 16 * sizeof(float) : 0;
+
+        /* the blobs go first, a record must be filled right away */
+        od.indices = raw_blob(w, d->indices);
+        raw_array(w, &od.arrays[0], &d->vertexpointer);
+        raw_array(w, &od.arrays[1], &d->normalpointer);
+        raw_array(w, &od.arrays[2], &d->texcoordpointer);
+        raw_array(w, &od.arrays[3], &d->colorpointer);
+
+        r = raw_record(w, OGR_DRAW, sizeof(od) + mv);
+        memcpy(r, &od, sizeof(od));
+        if (mv)
+            memcpy(r + sizeof(od), d->modelview, mv);
+    }
+
+    for (call = c->all_listcalls; call; call = call->next) {
+        struct ogr_call_t oc = {
+            .n         = call->n,
+            .frame     = call->frame,
+            .capture   = call->capture,
+            .list      = raw_list(w, call->list),
+            .modelview = ogr_modelview(call->modelview, call->absolute),
+        };
+        size_t mv = call->modelview ? 16 * sizeof(float) : 0;
+
+        r = raw_record(w, OGR_CALL, sizeof(oc) + mv);
+        memcpy(r, &oc, sizeof(oc));
+        if (mv)
+            memcpy(r + sizeof(oc), call->modelview, mv);
+    }
+}
+
+/* id of list l, it's defined in the segment on first use */
+uint32_t raw_list(struct raw_writer_t * w, struct dlist_t * l)
+{
+    struct listcall_t * call;
+    uint32_t id, * slot;
+    char * r;
+
+    slot = raw_id(w, l);
+    if (*slot)
+        return *slot - 1;
+
+    /* definitions don't nest, the lists it calls go first */
+    for (call = l->cap->all_listcalls; call; call = call->next)
+        raw_list(w, call->list);
+
+    id = w->lists++;
+    *raw_id(w, l) = id + 1;
+    r = raw_record(w, OGR_LIST, sizeof(id));
+    memcpy(r, &id, sizeof(id));
+    raw_capture(w, l->cap);
+    raw_record(w, OGR_LIST_END, 0);
+    return id;
+}
+
+void raw_export(struct capture_t * c)
+{
+    static __thread struct raw_writer_t w;
+
+    w.segment = __atomic_fetch_add(&raw_segments, 1, __ATOMIC_RELAXED);
+    w.blobs   = 0;
+    w.lists   = 0;
+    w.used    = 0;
+    if (w.ids_used) {
+        memset(w.ids_key, 0, w.ids_size * sizeof(*w.ids_key));
+        w.ids_used = 0;
+    }
+
+    raw_capture(&w, c);
+
+    raw_record(&w, OGR_END, 0);
+    raw_chunk(&w);
+    printf("+++ streamed %d prims, %d DrawElements and %d list calls\n",
+            c->nPrim, c->nDrawElements, c->nListCalls);
+}
+
+void raw_close(void)
+{
+    if (raw_fd < 0)
+        return;
+    close(raw_fd);
+    raw_fd = -1;
+    printf("+++ raw stream %s/" OGR_FNAME " has %llu bytes in %u segments\n",
+            FNAME_PREFIX, (unsigned long long) raw_bytes, raw_segments);
+}
+
+/**************************************************************/
+/* geometry dedup                                             */
+/* every object is fingerprinted before it's converted, from  */
+/* the hashes its copies already have where possible. one of  */
+/* geometry written before is only counted. the manifest     */
+/* lists every mesh and all the places it occurred in.        */
+
+#define MESH_BUCKETS 65536 /* must be a power of 2 */
+#define MANIFEST_FNAME "manifest.txt"
+
+int dedup_mode = 1; /* OGLDUMP_DEDUP */
+
+enum { OBJ_PRIM, OBJ_DRAW, OBJ_CALL };
+const char * const obj_names[] = { "prim", "drawelements", "calllist" };
+
+struct occurrence_t {
+    int32_t  n;
+    uint32_t kind;    /* OBJ_* */
+    uint32_t frame;
+    uint32_t capture;
+    float  * matrix;  /* of the instance with glTF, NULL for the identity */
+};
+
+/* what a mesh is told apart by. a 64 bit hash alone might */
+/* collide, the sizes of the geometry have to match as well */
+struct mesh_key_t {
+    uint64_t hash;
+    uint32_t kind;        /* OBJ_* */
+    uint32_t n_tri;       /* as gl_triangle_count() counts */
+    uint64_t bytes;       /* of the vertex data the hash covers */
+};
+
+struct mesh_t {
+    struct mesh_t       * next;
+    struct mesh_key_t     key;
+    struct occurrence_t * occ;   /* occ[0] is the one that was written */
+    uint32_t              n_occ;
+    uint32_t              size;
+
+    /* with glTF, where in scene.bin it was written */
+    uint64_t              offset;
+    uint32_t              n_vertices;
+    float                 min[3];
+    float                 max[3];
+};
+
+pthread_mutex_t   meshes_lock   = PTHREAD_MUTEX_INITIALIZER;
+struct mesh_t  ** meshes        = NULL;
+uint32_t          n_meshes      = 0;
+uint64_t          n_duplicates  = 0;
+
+static inline uint64_t hash_combine(uint64_t h, uint64_t k)
+{
+    return h ^ (k + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+}
+
+static inline uint64_t hash_modelview(uint64_t h, const float * m)
+{
+    return hash_combine(h, m ? hash_bytes(m, 16 * sizeof(float)) : 0);
+}
+
+/* in a list, an absolute modelview is not the relative one */
+static inline uint64_t hash_absolute(uint64_t h, int absolute)
+{
+    return absolute ? hash_combine(h, 1) : h;
+}
+
+/* the geometry in object space, glTF instances share it */
+uint64_t hash_prim_geometry(struct capture_t * c, struct prim_t * p)
+{
+    uint64_t h = hash_bytes(&c->vstore.v[3 * p->first], 3 * sizeof(float) * p->nV3);
+    h = hash_combine(h, hash_bytes(&c->vstore.n[3 * p->first],
+                3 * sizeof(float) * p->nV3));
+    return hash_combine(h, ((uint64_t) p->type << 32) | p->nV3);
+}
+
+uint64_t hash_prim(struct capture_t * c, struct prim_t * p)
+{
+    return hash_modelview(hash_prim_geometry(c, p), p->modelview);
+}
+
+/* the copies are blobs, their hashes are known */
+static inline uint64_t hash_array(uint64_t h, const struct vertexpointer_t * v)
+{
+    if (!v->size)
+        return hash_combine(h, 0);
+    h = hash_combine(h, blob_of(v->ptr_copy)->hash);
+    h = hash_combine(h, ((uint64_t) v->size << 48) ^ ((uint64_t) v->type << 32) ^
+            (uint32_t) v->stride);
+    return hash_combine(h, ((uint64_t) v->min_index << 32) | v->max_index);
+}
+
+uint64_t hash_draw_geometry(struct drawelements_t * d)
+{
+    uint64_t h = ((uint64_t) d->mode << 32) ^ (uint32_t) d->count;
+    h = hash_combine(h, d->indices ? blob_of(d->indices)->hash ^ d->type : 0);
+    h = hash_array(h, &d->vertexpointer);
+    return hash_array(h, &d->normalpointer);
+}
+
+uint64_t hash_draw(struct drawelements_t * d)
+{
+    return hash_modelview(hash_draw_geometry(d), d->modelview);
+}
+
+/* a list by its content, so identical lists of other segments */
+/* or versions match. it never changes, so it's kept.           */
+uint64_t hash_list(struct dlist_t * l, int depth)
+{
+    struct capture_t * c = l->cap;
+    struct prim_t * p;
+    struct drawelements_t * d;
+    struct listcall_t * call;
+    uint64_t h;
+
+    if (__atomic_load_n(&l->hashed, __ATOMIC_ACQUIRE))
+        return l->hash;
+    h = 0;
+    if (depth < DLIST_NESTING_MAX) {
+        for (p = c->all_prims; p; p = p->next)
+            h = hash_absolute(hash_combine(h, hash_prim(c, p)), p->absolute);
+        for (d = c->all_drawelements; d; d = d->next)
+            h = hash_absolute(hash_combine(h, hash_draw(d)), d->absolute);
+        for (call = c->all_listcalls; call; call = call->next)
+            h = hash_absolute(hash_modelview(hash_combine(h,
+                        hash_list(call->list, depth + 1)), call->modelview),
+                    call->absolute);
+    }
+    /* exporters may race here, they all come up with the same */
+    l->hash = h;
+    __atomic_store_n(&l->hashed, 1, __ATOMIC_RELEASE);
+    return h;
+}
+
+uint64_t hash_call(struct listcall_t * call)
+{
+    return hash_modelview(hash_list(call->list, 0), call->modelview);
+}
+
+uint64_t prim_bytes(struct prim_t * p)
+{
+    return 2 * 3 * sizeof(float) * (uint64_t) p->nV3;
+}
+
+static inline uint64_t array_bytes(const struct vertexpointer_t * v)
+{
+    return v->size ? blob_of(v->ptr_copy)->len : 0;
+}
+
+uint64_t draw_bytes(struct drawelements_t * d)
+{
+    return array_bytes(&d->vertexpointer) + array_bytes(&d->normalpointer);
+}
+
+uint64_t list_bytes(struct dlist_t * l, int depth)
+{
+    struct capture_t * c = l->cap;
+    struct prim_t * p;
+    struct drawelements_t * d;
+    struct listcall_t * call;
+    uint64_t n = 0;
+
+    if (depth >= DLIST_NESTING_MAX)
+        return 0;
+    for (p = c->all_prims; p; p = p->next)
+        n += prim_bytes(p);
+    for (d = c->all_drawelements; d; d = d->next)
+        n += draw_bytes(d);
+    for (call = c->all_listcalls; call; call = call->next)
+        n += list_bytes(call->list, depth + 1);
+    return n;
+}
+
+struct mesh_key_t key_prim(uint64_t hash, struct prim_t * p)
+{
+    return (struct mesh_key_t) { hash, OBJ_PRIM,
+        gl_triangle_count(p->type, p->nV3), prim_bytes(p) };
+}
+
+struct mesh_key_t key_draw(uint64_t hash, struct drawelements_t * d)
+{
+    return (struct mesh_key_t) { hash, OBJ_DRAW,
+        gl_triangle_count(d->mode, d->count), draw_bytes(d) };
+}
+
+struct mesh_key_t key_call(uint64_t hash, struct listcall_t * call)
+{
+    return (struct mesh_key_t) { hash, OBJ_CALL,
+        list_triangle_count(call->list, 0), list_bytes(call->list, 0) };
+}
+
+/* count an occurrence of the mesh of key. *seen is set if it */
+/* occurred before, it needn't be written again then.         */
+struct mesh_t * mesh_add(const struct mesh_key_t * key, int n, uint32_t frame,
+        uint32_t capture, const float * matrix, int * seen)
+{
+    struct mesh_t * m;
+    float * copy = NULL;
+
+    if (matrix) {
+        copy = malloc(16 * sizeof(float));
+        if (!copy) enomem();
+        memcpy(copy, matrix, 16 * sizeof(float));
+    }
+    *seen = 1;
+    pthread_mutex_lock(&meshes_lock);
+    if (!meshes) {
+        meshes = calloc(MESH_BUCKETS, sizeof(*meshes));
+        if (!meshes) enomem();
+    }
+    struct mesh_t ** head = &meshes[key->hash & (MESH_BUCKETS - 1)];
+    for (m = *head; m; m = m->next)
+        if (m->key.hash == key->hash && m->key.kind == key->kind &&
+                m->key.n_tri == key->n_tri && m->key.bytes == key->bytes)
+            break;
+    if (!m) {
+        m = calloc(1, sizeof(*m));
+        if (!m) enomem();
+        m->key  = *key;
+        m->next = *head;
+        *head   = m;
+        n_meshes++;
+        *seen = 0;
+    } else {
+        n_duplicates++;
+    }
+    if (m->n_occ == m->size) {
+        m->size = m->size ? 2 * m->size : 4;
+        m->occ  = realloc(m->occ, m->size * sizeof(*m->occ));
+        if (!m->occ) enomem();
+    }
+    m->occ[m->n_occ++] = (struct occurrence_t) { n, key->kind, frame, capture, copy };
+    pthread_mutex_unlock(&meshes_lock);
+    return m;
+}
+
+/* 1 if an object of this geometry was written before */
+int mesh_seen(struct mesh_key_t key, int n, uint32_t frame, uint32_t capture)
+{
+    int seen;
+
+    if (!dedup_mode)
+        return 0;
+    mesh_add(&key, n, frame, capture, NULL, &seen);
+    return seen;
+}
+
+int occurrence_cmp(const void * a, const void * b)
+{
+    const struct occurrence_t * x = a, * y = b;
+    if (x->kind != y->kind)
+        return x->kind < y->kind ? -1 : 1;
+    return x->n < y->n ? -1 : x->n > y->n;
+}
+
+/* by the first occurrence, the one written */
+int mesh_cmp(const void * a, const void * b)
+{
+    const struct mesh_t * x = *(struct mesh_t * const *) a;
+    const struct mesh_t * y = *(struct mesh_t * const *) b;
+    return occurrence_cmp(&x->occ[0], &y->occ[0]);
+}
+
+/* all meshes in the order of the objects they were written as, */
+/* once all exporters are done                                   */
+struct mesh_t ** meshes_sorted(void)
+{
+    struct mesh_t ** all, * m;
+    uint32_t i, k = 0;
+
+    all = malloc(n_meshes * sizeof(*all));
+    if (!all) enomem();
+    for (i=0; i<MESH_BUCKETS; i++)
+        for (m = meshes[i]; m; m = m->next) {
+            /* the one written is kept first, the others are sorted */
+            qsort(m->occ + 1, m->n_occ - 1, sizeof(*m->occ), occurrence_cmp);
+            all[k++] = m;
+        }
+    qsort(all, n_meshes, sizeof(*all), mesh_cmp);
+    return all;
+}
+
+/* one line per mesh: the object it was written as, the number */
+/* of occurrences and each as object:frame:capture              */
+void mesh_manifest(void)
+{
+    char fname[256];
+    struct mesh_t ** all, * m;
+    uint32_t i, j;
+    FILE * f;
+
+    if (!n_meshes)
+        return;
+    all = meshes_sorted();
+
+    snprintf(fname, sizeof(fname), "%s/" MANIFEST_FNAME, FNAME_PREFIX);
+    f = fopen(fname, "w");
+    if (!f) {
+        printf("!!! couldn't fopen(%s): %s\n", fname, strerror(errno));
+        free(all);
+        return;
+    }
+    fprintf(f, "# mesh occurrences object:frame:capture ...\n");
+    for (i=0; i<n_meshes; i++) {
+        m = all[i];
+        fprintf(f, "%s_%.7d %u", obj_names[m->occ[0].kind], m->occ[0].n, m->n_occ);
+        for (j=0; j<m->n_occ; j++)
+            fprintf(f, " %s_%.7d:%u:%u", obj_names[m->occ[j].kind],
+                    m->occ[j].n, m->occ[j].frame, m->occ[j].capture);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+    free(all);
+    printf("+++ %u distinct meshes, %llu repeats of them, see %s\n",
+            n_meshes, (unsigned long long) n_duplicates, fname);
+}
+
+/**************************************************************/
+/* instanced glTF export                                      */
+/* with OGLDUMP_FORMAT=gltf meshes are keyed by their content */
+/* in object space. each is written once to scene.bin, every  */
+/* draw of it becomes a node of scene.gltf, with the          */
+/* modelview it was drawn with as its matrix.                 */
+
+#define GLTF_BIN_FNAME   "scene.bin"
+#define GLTF_FNAME       "scene.gltf"
+#define GLTF_VERTEX_SIZE 24 /* x,y,z and the normal, as in PLY */
+
+pthread_mutex_t gltf_lock = PTHREAD_MUTEX_INITIALIZER;
+int             gltf_fd   = -1; /* scene.bin, opened with the 1st mesh */
+uint64_t        gltf_end  = 0;
+
+/* the mesh of key to be written by w, NULL if it was written   */
+/* before or there's nothing to write. key.n_tri is an upper bound. */
+struct mesh_t * gltf_open_mesh(struct stl_writer_t * w, struct mesh_key_t key,
+        int n, uint32_t frame, uint32_t capture, const float * modelview)
+{
+    char fname[256];
+    struct mesh_t * m;
+    uint32_t n_tri = key.n_tri;
+    int seen;
+
+    m = mesh_add(&key, n, frame, capture, modelview, &seen);
+    if (seen || !n_tri)
+        return NULL;
+
+    pthread_mutex_lock(&gltf_lock);
+    if (gltf_fd < 0) {
+        snprintf(fname, sizeof(fname), "%s/" GLTF_BIN_FNAME, FNAME_PREFIX);
+        gltf_fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (gltf_fd < 0) {
+            printf("!!! couldn't open(%s): %s\n", fname, strerror(errno));
+            pthread_mutex_unlock(&gltf_lock);
+            return NULL;
+        }
+    }
+    w->base   = gltf_end;
+    gltf_end += (uint64_t) n_tri * 3 * GLTF_VERTEX_SIZE;
+    pthread_mutex_unlock(&gltf_lock);
+
+    w->fd     = gltf_fd;
+    w->cont   = NULL;
+    w->format = FORMAT_GLTF;
+    stl_begin(w, n_tri);
+    return m;
+}
+
+void gltf_close_mesh(struct stl_writer_t * w, struct mesh_t * m)
+{
+    stl_flush(w);
+    memcpy(m->min, w->min, sizeof(m->min));
+    memcpy(m->max, w->max, sizeof(m->max));
+    m->offset     = w->base;
+    m->n_vertices = 3 * w->n_triangles;
+}
+
+void gltf_export(struct capture_t * c)
+{
+    struct convbuf_t b = { NULL, NULL, 0 };
+    struct stl_writer_t w;
+    struct prim_t * p;
+    struct drawelements_t * d;
+    struct listcall_t * call;
+    struct mesh_t * m;
+
+    for (p = c->all_prims; p; p = p->next) {
+        if (p->nV3 <= 8)
+            continue; /* as in capture_export() */
+        m = gltf_open_mesh(&w, key_prim(hash_prim_geometry(c, p), p), p->n,
+                p->frame, p->capture, p->modelview);
+        if (!m)
+            continue;
+        struct vsource_t s = {
+            .v       = &c->vstore.v[3 * p->first],
+            .n       = &c->vstore.n[3 * p->first],
+            .normals = NORMAL_PROVOKING,
+            .vstride = 3,
+            .nstride = 3,
+        };
+        assemble(&w, p->type, p->nV3, &s);
+        gltf_close_mesh(&w, m);
+    }
+
+    for (d = c->all_drawelements; d; d = d->next) {
+        m = gltf_open_mesh(&w, key_draw(hash_draw_geometry(d), d), d->n,
+                d->frame, d->capture, d->modelview);
+        if (!m)
+            continue;
+        draw_convert(&b, d, NULL);
+        assemble_draw(&w, d, b.v, b.n);
+        gltf_close_mesh(&w, m);
+    }
+
+    for (call = c->all_listcalls; call; call = call->next) {
+        /* what a list draws after loading a matrix isn't in its */
+        /* object space, such a call is a mesh of its own        */
+        int placed = call->list->has_absolute;
+        m = gltf_open_mesh(&w, key_call(placed ? hash_call(call) :
+                    hash_list(call->list, 0), call), call->n, call->frame,
+                call->capture, placed ? NULL : call->modelview);
+        if (!m)
+            continue;
+        list_export(&w, call->list, placed ? call->modelview : NULL, &b, 0);
+        gltf_close_mesh(&w, m);
+    }
+    free(b.v);
+    free(b.n);
+    printf("+++ instanced %d prims, %d DrawElements and %d list calls\n",
+            c->nPrim, c->nDrawElements, c->nListCalls);
+}
+
+void gltf_floats(FILE * f, const float * v, int n)
+{
+    int i;
+    for (i=0; i<n; i++)
+        fprintf(f, "%s%.9g", i ? "," : "[", v[i]);
+    fprintf(f, "]");
+}
+
+/* one glTF mesh, accessor pair and buffer view per mesh with */
+/* triangles, one node per occurrence. once all writers are done. */
+void gltf_finish(void)
+{
+    char fname[256];
+    struct mesh_t ** all, * m;
+    struct occurrence_t * o;
+    uint32_t i, j, k;
+    FILE * f;
+
+    if (gltf_fd < 0)
+        return;
+    close(gltf_fd);
+    gltf_fd = -1;
+
+    snprintf(fname, sizeof(fname), "%s/" GLTF_FNAME, FNAME_PREFIX);
+    f = fopen(fname, "w");
+    if (!f) {
+        printf("!!! couldn't fopen(%s): %s\n", fname, strerror(errno));
+        return;
+    }
+    all = meshes_sorted();
+    for (i=0, k=0; i<n_meshes; i++)
+        if (all[i]->n_vertices)
+            all[k++] = all[i];
+
+    fprintf(f, "{\n\"asset\":{\"version\":\"2.0\",\"generator\":\"ogldump\"},\n");
+    fprintf(f, "\"buffers\":[{\"uri\":\"" GLTF_BIN_FNAME "\",\"byteLength\":%llu}],\n",
+            (unsigned long long) gltf_end);
+
+    fprintf(f, "\"bufferViews\":[");
+    for (i=0; i<k; i++)
+        fprintf(f, "%s\n{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%u,"
+                "\"byteStride\":%d,\"target\":34962}", i ? "," : "",
+                (unsigned long long) all[i]->offset,
+                all[i]->n_vertices * GLTF_VERTEX_SIZE, GLTF_VERTEX_SIZE);
+    fprintf(f, "],\n");
+
+    /* positions and normals, 5126 is GL_FLOAT */
+    fprintf(f, "\"accessors\":[");
+    for (i=0; i<k; i++) {
+        m = all[i];
+        fprintf(f, "%s\n{\"bufferView\":%u,\"componentType\":5126,\"count\":%u,"
+                "\"type\":\"VEC3\",\"min\":", i ? "," : "", i, m->n_vertices);
+        gltf_floats(f, m->min, 3);
+        fprintf(f, ",\"max\":");
+        gltf_floats(f, m->max, 3);
+        fprintf(f, "},\n{\"bufferView\":%u,\"byteOffset\":12,\"componentType\":5126,"
+                "\"count\":%u,\"type\":\"VEC3\"}", i, m->n_vertices);
+    }
+    fprintf(f, "],\n");
+
+    fprintf(f, "\"meshes\":[");
+    for (i=0; i<k; i++)
+        fprintf(f, "%s\n{\"name\":\"%s_%.7d\",\"primitives\":[{\"attributes\":"
+                "{\"POSITION\":%u,\"NORMAL\":%u},\"mode\":4}]}", i ? "," : "",
+                obj_names[all[i]->occ[0].kind], all[i]->occ[0].n, 2 * i, 2 * i + 1);
+    fprintf(f, "],\n");
+
+    fprintf(f, "\"nodes\":[");
+    uint32_t n_nodes = 0;
+    for (i=0; i<k; i++)
+        for (j=0; j<all[i]->n_occ; j++) {
+            o = &all[i]->occ[j];
+            fprintf(f, "%s\n{\"name\":\"%s_%.7d\",\"mesh\":%u,", n_nodes++ ? "," : "",
+                    obj_names[o->kind], o->n, i);
+            if (o->matrix) {
+                fprintf(f, "\"matrix\":");
+                gltf_floats(f, o->matrix, 16);
+                fprintf(f, ",");
+            }
+            fprintf(f, "\"extras\":{\"frame\":%u,\"capture\":%u}}",
+                    o->frame, o->capture);
+        }
+    fprintf(f, "],\n");
+
+    fprintf(f, "\"scenes\":[{\"nodes\":[");
+    for (i=0; i<n_nodes; i++)
+        fprintf(f, "%s%u", i ? "," : "", i);
+    fprintf(f, "]}],\n\"scene\":0\n}\n");
+    fclose(f);
+    free(all);
+    printf("+++ wrote %u meshes and %u instances to %s\n", k, n_nodes, fname);
+}
+
+void do_DrawElements(struct capture_t * c)
+{
+    struct drawelements_t * p = c->all_drawelements;
+    struct convbuf_t b = { NULL, NULL, 0 };
+    int written = 0;
+
+    for (; p; p = p->next) {
+        //		printf("+++ writing DrawElement %d\n", p->n);
+        if (mesh_seen(key_draw(hash_draw(p), p), p->n, p->frame, p->capture))
+            continue;
+        draw_convert(&b, p, p->modelview);
+        written += do_file_DrawElements(p->n, p, b.v, b.n);
+    }
+    free(b.v);
+    free(b.n);
+    printf("+++ wrote a total of %d DrawElements\n", written);
+}
+
+void do_ListCalls(struct capture_t * c)
+{
+    struct listcall_t * call;
+    struct convbuf_t b = { NULL, NULL, 0 };
+    char name[OGD_NAME_LEN];
+    struct stl_writer_t w;
+    int written = 0;
+
+    for (call = c->all_listcalls; call; call = call->next) {
+        struct mesh_key_t key = key_call(hash_call(call), call);
+        if (mesh_seen(key, call->n, call->frame, call->capture))
+            continue;
+        sprintf(name, "calllist_%.7d", call->n);
+        if (stl_open_object(&w, name, call->frame, call->capture, key.n_tri))
+            continue;
+        list_export(&w, call->list, call->modelview, &b, 0);
+        stl_close(&w);
+        written++;
+    }
+    free(b.v);
+    free(b.n);
+    if (c->nListCalls)
+        printf("+++ wrote a total of %d list calls\n", written);
+}
+
+void capture_export(struct capture_t * c)
+{
+    int large=0;
+    struct prim_t * p = c->all_prims;
+
+    if (output_format == FORMAT_RAW) {
+        raw_export(c);
+        return;
+    }
+    if (output_format == FORMAT_GLTF) {
+        gltf_export(c);
+        return;
+    }
+    while (p) {
+        //		if (p->nV3 > 256) {
+        if (p->nV3 > 8 && !mesh_seen(key_prim(hash_prim(c, p), p), p->n,
+                    p->frame, p->capture)) {
+            //		if (p->nV3 > 0) {
+            printf("+++ prim %d has %d vertices\n", p->n, p->nV3);
+            //dump_prim(p->n, p);
+            large += switch_gl_primitive(p->n, c, p);
+        }
+        p = p->next;
+    }
+
+    do_DrawElements(c);
+    do_ListCalls(c);
+
+    printf("+++ wrote a total of %d prims\n", large);
+}
+
+/**************************************************************/
+/* asynchronous exporter                                      */
+/* with OGLDUMP_ASYNC=1 finished captures are queued to      */
+/* writer threads, the GL threads only ever record. the queue */
+/* is a bounded lock-free ring any thread may publish to and  */
+/* any writer may take from.                                  */
+
+#define ASYNC_QUEUE_DEFAULT 8
+#define ASYNC_BATCH_DEFAULT (16 * 1024 * 1024)
+#define EXPORT_THREADS_MAX  16
+
+int      async_mode     = 0;
+uint32_t async_queue    = ASYNC_QUEUE_DEFAULT;
+size_t   async_batch    = ASYNC_BATCH_DEFAULT; /* bytes per hand-off */
+uint32_t export_threads = 1;
+
+struct export_slot_t {
+    uint32_t           seq;
+    struct capture_t * c;
+};
+
+struct export_queue_t {
+    struct export_slot_t * ring;
+    uint32_t               mask;  /* ring size - 1, size is a power of 2 */
+    uint32_t               head;  /* next slot a writer takes */
+    uint32_t               tail;  /* next slot a recorder fills */
+    sem_t                  items;
+    int                    quit;
+    int                    nthreads;
+    pthread_t              thread[EXPORT_THREADS_MAX];
+} exq;
+
+/* spins while the queue is full, so memory stays bounded */
+/* 0 if the queue is full */
+int exporter_trypush(struct capture_t * c)
+{
+    struct export_slot_t * slot;
+    uint32_t pos = __atomic_load_n(&exq.tail, __ATOMIC_RELAXED);
+
+    for (;;) {
+        slot = &exq.ring[pos & exq.mask];
+        int32_t dif = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&exq.tail, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&exq.tail, __ATOMIC_RELAXED);
+        }
+    }
+    slot->c = c;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    sem_post(&exq.items);
+    return 1;
+}
+
+void exporter_push(struct capture_t * c)
+{
+    while (!exporter_trypush(c))
+        sched_yield(); /* full, the writer is behind */
+}
+
+/* NULL if the next slot isn't published yet */
+struct capture_t * exporter_pop(void)
+{
+    struct export_slot_t * slot;
+    struct capture_t * c;
+    uint32_t pos = __atomic_load_n(&exq.head, __ATOMIC_RELAXED);
+
+    for (;;) {
+        slot = &exq.ring[pos & exq.mask];
+        int32_t dif = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&exq.head, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&exq.head, __ATOMIC_RELAXED);
+        }
+    }
+    c = slot->c;
+    __atomic_store_n(&slot->seq, pos + exq.mask + 1, __ATOMIC_RELEASE);
+    return c;
+}
+
+void ring_recycle(struct capture_t * c);
+
+void * exporter_thread(void * arg)
+{
+    struct capture_t * c;
+
+    for (;;) {
+        while (sem_wait(&exq.items) && errno == EINTR)
+            ;
+        c = exporter_pop();
+        if (!c) {
+            if (__atomic_load_n(&exq.quit, __ATOMIC_ACQUIRE))
+                break;
+            /* a recorder is just publishing, wait for its slot */
+            sem_post(&exq.items);
+            sched_yield();
+            continue;
+        }
+        capture_export(c);
+        if (c->owner)
+            ring_recycle(c);
+        else
+            capture_release(c);
+    }
+    return NULL;
+}
+
+void exporter_start(uint32_t queue_size, int nthreads)
+{
+    uint32_t size = 1, i;
+
+    while (size < queue_size)
+        size <<= 1;
+    exq.ring = calloc(size, sizeof(*exq.ring));
+    if (!exq.ring) enomem();
+    for (i=0; i<size; i++)
+        exq.ring[i].seq = i;
+    exq.mask = size - 1;
+    sem_init(&exq.items, 0, 0);
+    for (i=0; i<nthreads; i++) {
+        if (pthread_create(&exq.thread[i], NULL, exporter_thread, NULL))
+            break;
+        exq.nthreads++;
+    }
+    if (!exq.nthreads) {
+        printf("!!! couldn't start exporter thread, exporting at exit\n");
+        async_mode = 0;
+        return;
+    }
+    printf("+++ started %d exporter threads, queue of %d\n", exq.nthreads, size);
+}
+
+/* drains the queue and waits for the writers to finish */
+void exporter_stop(void)
+{
+    int i;
+
+    __atomic_store_n(&exq.quit, 1, __ATOMIC_RELEASE);
+    for (i=0; i<exq.nthreads; i++)
+        sem_post(&exq.items);
+    for (i=0; i<exq.nthreads; i++)
+        pthread_join(exq.thread[i], NULL);
+}
+
+/* hand the recorder's capture to the exporter and start a new one. */
+/* only ever called outside of glBegin()/glEnd().                    */
+void capture_flush(struct recorder_t * r)
+{
+    struct capture_t * c = r->cap;
+
+    if (r->list || (!c->nPrim && !c->nDrawElements && !c->nListCalls))
+        return;
+    r->cap = capture_new();
+    exporter_push(c);
+}
+
+/* in async mode, hand off once enough has been recorded */
+static inline void capture_check(struct recorder_t * r)
+{
+    if (async_mode && !ring_frames && !r->current_prim && !r->list &&
+            capture_size(r->cap) >= async_batch)
+        capture_flush(r);
+}
+
+/**************************************************************/
+/* flight recorder                                            */
+/* with OGLDUMP_RING every context keeps its last frames in a */
+/* ring of captures. they come from a pool allocated when the */
+/* context first draws, each with an arena and a vertex store */
+/* that never grow, so a frame costs no allocation. at most   */
+/* ring_contexts pools are made, which bounds the memory. a   */
+/* thread's own context gives its pool back when the thread   */
+/* exits. what doesn't fit a capture is dropped. a trigger    */
+/* freezes the ring and hands its frames to the exporter,     */
+/* which gives the captures back to the pool once written.    */
+
+#define RING_FRAME_MIN (128 * 1024) /* the blob table takes 32k */
+
+struct ring_t {
+    struct ring_t         * next;     /* all of them */
+    struct ring_t         * next_idle; /* given back, see ring_release() */
+    struct capture_t      * cap;      /* recorded into while not current */
+    struct capture_t     ** frames;   /* past frames, see ring_frame_end() */
+    uint32_t                head;     /* the oldest of them */
+    uint32_t                count;
+    uint32_t                frozen;   /* nCaptures at the last freeze */
+    struct capture_t      * free;     /* spare captures of the pool */
+    struct capture_t      * returned; /* pushed back by the exporter */
+};
+
+struct ring_t * all_rings  = NULL;
+struct ring_t * idle_rings = NULL;
+uint32_t        nRings     = 0;
+uint32_t        ring_discarded = 0; /* frames of released rings */
+pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ring_frame_max bytes, a quarter of them for the vertex store */
+struct capture_t * ring_capture_new(struct ring_t * g)
+{
+    uint32_t vertices = ring_frame_max / 4 / (6 * sizeof(float));
+    struct capture_t * c;
+
+    c = capture_alloc(ring_frame_max - (size_t) vertices * 6 * sizeof(float));
+    c->arena.fixed = 1;
+    vstore_reserve(&c->vstore, vertices);
+    c->owner = g;
+    return c;
+}
+
+/* the pool is ring_frames captures plus the one recorded into */
+struct ring_t * ring_new(void)
+{
+    struct ring_t * g;
+    struct capture_t * c;
+    uint32_t i;
+
+    g = calloc(1, sizeof(*g));
+    if (!g) enomem();
+    g->frames = malloc(ring_frames * sizeof(*g->frames));
+    if (!g->frames) enomem();
+    for (i=0; i<ring_frames; i++) {
+        c = ring_capture_new(g);
+        c->next_free = g->free;
+        g->free = c;
+    }
+    g->cap = ring_capture_new(g);
+    return g;
+}
+
+/* the first draw of a context without a ring. 0 if none is left */
+__attribute__((noinline, cold))
+int ring_attach(struct recorder_t * r)
+{
+    struct context_t * g = r->gl;
+    struct ring_t * ring;
+
+    if (g->ring_none)
+        return 0;
+    pthread_mutex_lock(&rings_lock);
+    ring = idle_rings;
+    if (ring) {
+        idle_rings = ring->next_idle;
+    } else if (nRings < ring_contexts) {
+        ring = ring_new();
+        ring->next = all_rings;
+        all_rings  = ring;
+        nRings++;
+    } else {
+        static int said = 0;
+        g->ring_none = 1;
+        if (!said++)
+            printf("!!! flight recorder has no ring for more than %u contexts, "
+                    "raise OGLDUMP_RING_CONTEXTS\n", ring_contexts);
+    }
+    pthread_mutex_unlock(&rings_lock);
+    if (!ring)
+        return 0;
+
+    ring->frozen = __atomic_load_n(&nCaptures, __ATOMIC_ACQUIRE);
+    g->ring = ring;
+    r->cap  = ring->cap;
+    return 1;
+}
+
+/* the thread changes its current context. the capture recorded */
+/* into stays with the context it belongs to.                   */
+void ring_switch(struct recorder_t * r, struct context_t * g)
+{
+    if (ring_frames) {
+        /* glEndList() goes back to saved_cap */
+        struct capture_t ** cur = r->list ? &r->saved_cap : &r->cap;
+        if (r->gl && r->gl->ring)
+            r->gl->ring->cap = *cur;
+        *cur = g && g->ring ? g->ring->cap : NULL;
+    }
+    r->gl = g;
+}
+
+/* called by the exporter once c is written, from any thread */
+void ring_recycle(struct capture_t * c)
+{
+    struct ring_t * g = c->owner;
+
+    capture_reset(c);
+    c->next_free = __atomic_load_n(&g->returned, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&g->returned, &c->next_free, c, 1,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+}
+
+/* an empty capture of the pool */
+struct capture_t * ring_take(struct ring_t * g)
+{
+    struct capture_t * c = g->free;
+
+    if (!c)
+        c = __atomic_exchange_n(&g->returned, NULL, __ATOMIC_ACQUIRE);
+    if (c) {
+        g->free = c->next_free;
+        return c;
+    }
+    /* the spare ones are all still with the exporter */
+    c = g->frames[g->head];
+    g->head = (g->head + 1) % ring_frames;
+    g->count--;
+    if (c->nPrim || c->nDrawElements || c->nListCalls)
+        __atomic_fetch_add(&ring_lost, 1, __ATOMIC_RELAXED);
+    capture_reset(c);
+    return c;
+}
+
+/* the oldest frame goes back to the pool */
+void ring_drop_oldest(struct ring_t * g)
+{
+    struct capture_t * c = g->frames[g->head];
+
+    g->head = (g->head + 1) % ring_frames;
+    g->count--;
+    capture_reset(c);
+    c->next_free = g->free;
+    g->free = c;
+}
+
+/* a thread's own context is gone with the thread, its frames */
+/* are discarded and the ring is left for another context     */
+void ring_release(struct context_t * g)
+{
+    struct ring_t * ring = g->ring;
+
+    __atomic_fetch_add(&ring_discarded, ring->count, __ATOMIC_RELAXED);
+    while (ring->count)
+        ring_drop_oldest(ring);
+    capture_reset(ring->cap);
+    g->ring = NULL;
+
+    pthread_mutex_lock(&rings_lock);
+    ring->next_idle = idle_rings;
+    idle_rings = ring;
+    pthread_mutex_unlock(&rings_lock);
+}
+
+/* the recorder_key destructor */
+void ring_thread_exit(void * p)
+{
+    struct recorder_t * r = p;
+
+    if (!ring_frames || r->list)
+        return;
+    ring_switch(r, NULL); /* a context still current is kept as it is */
+    if (r->own && r->own->ring)
+        ring_release(r->own);
+}
+
+/* objects carry the capture they're exported with */
+void capture_relabel(struct capture_t * c, uint32_t capture)
+{
+    struct prim_t         * p;
+    struct drawelements_t * d;
+    struct listcall_t     * l;
+
+    for (p = c->all_prims; p; p = p->next)
+        p->capture = capture;
+    for (d = c->all_drawelements; d; d = d->next)
+        d->capture = capture;
+    for (l = c->all_listcalls; l; l = l->next)
+        l->capture = capture;
+}
+
+/* the context's frame is done, it takes the place of the */
+/* oldest one. called from the thread it is current on.   */
+void ring_frame_end(struct recorder_t * r)
+{
+    uint32_t frozen = __atomic_load_n(&nCaptures, __ATOMIC_ACQUIRE);
+    struct ring_t * g = r->gl->ring;
+    struct capture_t * c;
+
+    if (r->list || !g)
+        return;
+
+    if (g->count == ring_frames)
+        ring_drop_oldest(g);
+    g->frames[(g->head + g->count) % ring_frames] = r->cap;
+    g->count++;
+    r->cap = ring_take(g);
+    r->modelview_snapshot = NULL; /* it was in another capture */
+
+    if (g->frozen == frozen)
+        return;
+    g->frozen = frozen;
+
+    /* oldest first. the queue is never waited for, the app */
+    /* would stall in glXSwapBuffers()                      */
+    while (g->count) {
+        c = g->frames[g->head];
+        g->head = (g->head + 1) % ring_frames;
+        g->count--;
+        if (c->nPrim || c->nDrawElements || c->nListCalls) {
+            capture_relabel(c, frozen - 1);
+            if (exporter_trypush(c))
+                continue;
+            __atomic_fetch_add(&ring_lost, 1, __ATOMIC_RELAXED);
+        }
+        capture_reset(c);
+        c->next_free = g->free;
+        g->free = c;
+    }
+}
+
+/* from init(), the ring is written by the exporter threads */
+void ring_setup(void)
+{
+    if (!async_mode) {
+        printf("+++ OGLDUMP_RING implies OGLDUMP_ASYNC=1\n");
+        async_mode = 1;
+    }
+    if (async_queue < ring_frames)
+        async_queue = ring_frames;
+    if (ring_size / (ring_frames + 1) < RING_FRAME_MIN) {
+        uint32_t n = ring_size / RING_FRAME_MIN - 1;
+        printf("!!! OGLDUMP_RING_SIZE is too small for %u frames, keeping %u\n",
+                ring_frames, n);
+        ring_frames = n;
+    }
+    ring_frame_max = ring_size / (ring_frames + 1);
+    __atomic_fetch_or(&capturing, CAPTURE_FRAMES, __ATOMIC_RELAXED);
+    printf("+++ flight recorder keeps the last %u frames, %zu bytes each, "
+            "of up to %u contexts\n", ring_frames, ring_frame_max, ring_contexts);
+}
+
+/**************************************************************/
+/* raw stream replay                                          */
+/* ogldump_convert rebuilds the captures of a raw stream and  */
+/* hands them to the exporter, just as if they had been       */
+/* recorded in this process.                                  */
+
+struct segment_t {
+    struct segment_t * next;
+    uint32_t           id;
+    struct capture_t * cap;     /* records go here */
+    struct capture_t * top;     /* the segment's, while cap is a list's */
+    void **            blobs;   /* by id, blob_of() has the length */
+    uint32_t           n_blobs; /* room in blobs */
+    uint32_t           next_blob; /* ids are handed out in order */
+    struct dlist_t  ** lists;   /* by id, the segment holds a reference */
+    uint32_t           n_lists;
+    uint32_t           next_list;
+    struct dlist_t   * list;    /* being defined */
+};
+
+void * replay_blob(struct segment_t * s, uint32_t id)
+{
+    if (id == OGR_NO_BLOB)
+        return NULL;
+    if (id >= s->n_blobs || !s->blobs[id]) {
+        printf("!!! segment %u refers to missing blob %u\n", s->id, id);
+        return NULL;
+    }
+    return s->blobs[id];
+}
+
+/* in a list, objects after a matrix load, see dlist_t */
+static inline int replay_absolute(struct segment_t * s, uint32_t modelview,
+        size_t mv)
+{
+    return (modelview & OGR_MODELVIEW_ABSOLUTE) && mv && s->list;
+}
+
+int replay_prim(struct segment_t * s, const char * r, size_t len)
+{
+    struct capture_t * c = s->cap;
+    struct vstore_t * vs = &c->vstore;
+    struct ogr_prim_t op;
+    struct prim_t * p;
+    size_t mv, vn;
+
+    memcpy(&op, r, sizeof(op));
+    mv = op.modelview & OGR_MODELVIEW ? 16 * sizeof(float) : 0;
+    vn = 3 * sizeof(float) * (size_t) op.nV3;
+    if (len != sizeof(op) + mv + 2 * vn)
+        return -1;
+    r += sizeof(op);
+
+    p = arena_alloc(&c->arena, sizeof(*p));
+    p->next      = NULL;
+    p->n         = op.n;
+    p->frame     = op.frame;
+    p->capture   = op.capture;
+    p->type      = op.type;
+    p->nV3       = op.nV3;
+    p->first     = vs->count;
+    p->modelview = NULL;
+    if (mv) {
+        float * m = arena_alloc(&c->arena, mv);
+        memcpy(m, r, mv);
+        p->modelview = m;
+    }
+    p->absolute  = replay_absolute(s, op.modelview, mv);
+    while (vs->count + op.nV3 > vs->size)
+        vstore_grow(vs);
+    memcpy(&vs->v[3 * vs->count], r + mv,      vn);
+    memcpy(&vs->n[3 * vs->count], r + mv + vn, vn);
+    vs->count += op.nV3;
+
+    if (!c->last_prim)
+        c->all_prims = p;
+    else
+        c->last_prim->next = p;
+    c->last_prim = p;
+    c->nPrim++;
+    return 0;
+}
+
+void replay_array(struct segment_t * s, struct vertexpointer_t * v,
+        struct ogr_array_t * a)
+{
+    memset(v, 0, sizeof(*v));
+    v->size        = a->size;
+    v->type        = a->type;
+    v->stride      = a->stride;
+    v->sizeof_type = a->sizeof_type;
+    v->min_index   = a->min_index;
+    v->max_index   = a->max_index;
+    v->ptr_copy    = replay_blob(s, a->blob);
+    v->enabled     = v->size && v->ptr_copy;
+    if (!v->enabled)
+        v->size = 0;
+}
+
+/* whether the blob of v holds the elements min_index to max_index, */
+/* laid out as copy_vertexpointer() copied them                      */
+int replay_array_fits(const struct vertexpointer_t * v)
+{
+    uint64_t need;
+
+    if (v->sizeof_type != gl_type_size(v->type) || v->sizeof_type == 0 ||
+            v->size < 1 || v->size > 4 || v->stride <= 0 ||
+            v->min_index > v->max_index)
+        return 0;
+    need = (uint64_t) (v->max_index - v->min_index) * v->stride +
+        (uint64_t) v->size * v->sizeof_type;
+    return need <= blob_of(v->ptr_copy)->len;
+}
+
+/* a draw of a broken stream must not take the export out of */
+/* bounds. 0 if it can't be drawn.                           */
+int replay_draw_valid(struct segment_t * s, struct drawelements_t * d)
+{
+    struct vertexpointer_t * v = &d->vertexpointer;
+    struct vertexpointer_t * a[3] = {
+        &d->normalpointer, &d->texcoordpointer, &d->colorpointer };
+    uint32_t min = UINT32_MAX, max = 0;
+    int i;
+
+    if (!replay_array_fits(v) || !vconvert_lookup(v->type, v->size) ||
+            d->count < 0)
+        return 0;
+    for (i=0; i<3; i++)
+        if (a[i]->size && (!replay_array_fits(a[i]) ||
+                a[i]->min_index != v->min_index ||
+                a[i]->max_index != v->max_index)) {
+            printf("!!! segment %u: dropping a broken array of draw %d\n",
+                    s->id, d->n);
+            a[i]->size = 0;
+        }
+    if (d->normalpointer.size &&
+            !vconvert_lookup(d->normalpointer.type, d->normalpointer.size))
+        d->normalpointer.size = 0;
+
+    if (!d->indices) /* glDrawArrays(), vertices min_index on */
+        return d->type == 0 &&
+            (uint64_t) d->count <= (uint64_t) (v->max_index - v->min_index) + 1;
+
+    if (d->sizeof_type != gl_type_size(d->type) ||
+            (uint64_t) d->count * d->sizeof_type > blob_of(d->indices)->len)
+        return 0;
+    switch (d->type) {
+        case GL_UNSIGNED_BYTE:
+            index_range.u8(d->indices, d->count, &min, &max);
+            break;
+        case GL_UNSIGNED_SHORT:
+            index_range.u16(d->indices, d->count, &min, &max);
+            break;
+        case GL_UNSIGNED_INT:
+            index_range.u32(d->indices, d->count, &min, &max);
+            break;
+        default:
+            return 0;
+    }
+    return !d->count || (min >= v->min_index && max <= v->max_index);
+}
+
+int replay_draw(struct segment_t * s, const char * r, size_t len)
+{
+    struct capture_t * c = s->cap;
+    struct ogr_draw_t od;
+    struct drawelements_t * d;
+    size_t mv;
+
+    memcpy(&od, r, sizeof(od));
+    mv = od.modelview & OGR_MODELVIEW ? 16 * sizeof(float) : 0;
+    if (len != sizeof(od) + mv)
+        return -1;
+
+    d = arena_alloc(&c->arena, sizeof(*d));
+    d->next        = NULL;
+    d->n           = od.n;
+    d->frame       = od.frame;
+    d->capture     = od.capture;
+    d->mode        = od.mode;
+    d->count       = od.count;
+    d->type        = od.type;
+    d->sizeof_type = od.sizeof_type;
+    d->indices     = replay_blob(s, od.indices);
+    d->modelview   = NULL;
+    if (mv) {
+        float * m = arena_alloc(&c->arena, mv);
+        memcpy(m, r + sizeof(od), mv);
+        d->modelview = m;
+    }
+    d->absolute    = replay_absolute(s, od.modelview, mv);
+    replay_array(s, &d->vertexpointer,   &od.arrays[0]);
+    replay_array(s, &d->normalpointer,   &od.arrays[1]);
+    replay_array(s, &d->texcoordpointer, &od.arrays[2]);
+    replay_array(s, &d->colorpointer,    &od.arrays[3]);
+    if (!d->vertexpointer.size || (od.indices != OGR_NO_BLOB && !d->indices))
+        return 0; /* dropped, it stays in the arena */
+    if (!replay_draw_valid(s, d)) {
+        printf("!!! segment %u: draw %d doesn't fit its arrays, dropped\n",
+                s->id, d->n);
+        return 0;
+    }
+
+    if (!c->last_drawelements)
+        c->all_drawelements = d;
+    else
+        c->last_drawelements->next = d;
+    c->last_drawelements = d;
+    c->nDrawElements++;
+    return 0;
+}
+
+int replay_blob_record(struct segment_t * s, const char * r, size_t len)
+{
+    uint32_t id;
+
+    if (len < 4)
+        return -1;
+    memcpy(&id, r, 4);
+    if (id != s->next_blob)
+        return -1;
+    s->next_blob++;
+    if (id >= s->n_blobs) {
+        uint32_t n = s->n_blobs ? s->n_blobs : 256;
+        while (n <= id)
+            n *= 2;
+        s->blobs = realloc(s->blobs, n * sizeof(*s->blobs));
+        if (!s->blobs) enomem();
+        memset(s->blobs + s->n_blobs, 0, (n - s->n_blobs) * sizeof(*s->blobs));
+        s->n_blobs = n;
+    }
+    s->blobs[id] = capture_copy(s->cap, r + 4, len - 4);
+    return 0;
+}
+
+int replay_list(struct segment_t * s, const char * r, size_t len)
+{
+    struct dlist_t * l;
+    uint32_t id;
+
+    if (len != sizeof(id) || s->list)
+        return -1;
+    memcpy(&id, r, sizeof(id));
+    if (id != s->next_list)
+        return -1;
+    s->next_list++;
+    if (id >= s->n_lists) {
+        uint32_t n = s->n_lists ? s->n_lists : 64;
+        while (n <= id)
+            n *= 2;
+        s->lists = realloc(s->lists, n * sizeof(*s->lists));
+        if (!s->lists) enomem();
+        memset(s->lists + s->n_lists, 0, (n - s->n_lists) * sizeof(*s->lists));
+        s->n_lists = n;
+    }
+    l = calloc(1, sizeof(*l));
+    if (!l) enomem();
+    l->refs = 1;
+    l->cap  = capture_new();
+    s->lists[id] = l;
+    s->list = l;
+    s->top  = s->cap;
+    s->cap  = l->cap;
+    return 0;
+}
+
+int replay_list_end(struct segment_t * s)
+{
+    if (!s->list)
+        return -1;
+    s->list->has_absolute = dlist_has_absolute(s->list);
+    s->cap  = s->top;
+    s->list = NULL;
+    return 0;
+}
+
+int replay_call(struct segment_t * s, const char * r, size_t len)
+{
+    struct capture_t * c = s->cap;
+    struct ogr_call_t oc;
+    struct listcall_t * call;
+    size_t mv;
+
+    memcpy(&oc, r, sizeof(oc));
+    mv = oc.modelview & OGR_MODELVIEW ? 16 * sizeof(float) : 0;
+    if (len != sizeof(oc) + mv)
+        return -1;
+    if (oc.list >= s->n_lists || !s->lists[oc.list] ||
+            s->lists[oc.list] == s->list) {
+        printf("!!! segment %u calls undefined list %u\n", s->id, oc.list);
+        return 0;
+    }
+
+    call = arena_alloc(&c->arena, sizeof(*call));
+    call->next      = NULL;
+    call->n         = oc.n;
+    call->frame     = oc.frame;
+    call->capture   = oc.capture;
+    call->list      = s->lists[oc.list];
+    call->modelview = NULL;
+    if (mv) {
+        float * m = arena_alloc(&c->arena, mv);
+        memcpy(m, r + sizeof(oc), mv);
+        call->modelview = m;
+    }
+    call->absolute  = replay_absolute(s, oc.modelview, mv);
+    __atomic_add_fetch(&call->list->refs, 1, __ATOMIC_RELAXED);
+
+    if (!c->last_listcall)
+        c->all_listcalls = call;
+    else
+        c->last_listcall->next = call;
+    c->last_listcall = call;
+    c->nListCalls++;
+    return 0;
+}
+
+/* 1 once the segment is complete, -1 if the chunk is broken */
+int replay_records(struct segment_t * s, const char * p, size_t left)
+{
+    struct ogr_rec_t rec;
+    int ret;
+
+    while (left >= sizeof(rec)) {
+        memcpy(&rec, p, sizeof(rec));
+        p    += sizeof(rec);
+        left -= sizeof(rec);
+        if (rec.len > left)
+            return -1;
+        switch (rec.type) {
+            case OGR_BLOB:
+                ret = replay_blob_record(s, p, rec.len);
+                break;
+            case OGR_PRIM:
+                ret = rec.len < sizeof(struct ogr_prim_t) ? -1 :
+                    replay_prim(s, p, rec.len);
+                break;
+            case OGR_DRAW:
+                ret = rec.len < sizeof(struct ogr_draw_t) ? -1 :
+                    replay_draw(s, p, rec.len);
+                break;
+            case OGR_LIST:
+                ret = replay_list(s, p, rec.len);
+                break;
+            case OGR_LIST_END:
+                ret = replay_list_end(s);
+                break;
+            case OGR_CALL:
+                ret = rec.len < sizeof(struct ogr_call_t) ? -1 :
+                    replay_call(s, p, rec.len);
+                break;
+            case OGR_END:
+                return 1;
+            default:
+                printf("!!! skipping raw record of unknown type %u\n", rec.type);
+                ret = 0;
+                break;
+        }
+        if (ret < 0)
+            return -1;
+        p    += rec.len;
+        left -= rec.len;
+    }
+    return left ? -1 : 0;
+}
+
+void replay_export(struct segment_t * s)
+{
+    uint32_t i;
+
+    replay_list_end(s); /* of a list cut off */
+    if (async_mode) {
+        exporter_push(s->cap);
+    } else {
+        capture_export(s->cap);
+        capture_release(s->cap);
+    }
+    /* the calls hold the lists they need */
+    for (i=0; i<s->n_lists; i++)
+        if (s->lists[i])
+            dlist_put(s->lists[i]);
+    free(s->lists);
+    free(s->blobs);
+    free(s);
+}
+
+int ogr_replay(const char * fname, const char * dir, const char * format,
+        int threads)
+{
+    struct ogr_header_t h;
+    struct ogr_chunk_t ch;
+    struct segment_t * segments = NULL, * s, ** link;
+    char * buf = NULL, * raw = NULL;
+    size_t buf_size = 0, raw_size = 0;
+    int ret = 0, i;
+    FILE * f;
+
+    output_format = -1;
+    for (i=0; format_names[i]; i++)
+        if (!strcasecmp(format, format_names[i]))
+            output_format = i;
+    if (output_format < 0 || output_format == FORMAT_RAW) {
+        printf("!!! can't convert to %s\n", format);
+        return -1;
+    }
+    FNAME_PREFIX = (char *) dir;
+    if (mkdir(FNAME_PREFIX, 0755) < 0 && errno != EEXIST) {
+        printf("!!! ERROR creating %s: %s\n", FNAME_PREFIX, strerror(errno));
+        return -1;
+    }
+
+    f = fopen(fname, "r");
+    if (!f) {
+        printf("!!! couldn't fopen(%s): %s\n", fname, strerror(errno));
+        return -1;
+    }
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, OGR_MAGIC, 8) ||
+            h.version != OGR_VERSION) {
+        printf("!!! %s is no raw stream of version %u\n", fname, OGR_VERSION);
+        fclose(f);
+        return -1;
+    }
+
+    if (threads > 1) {
+        async_mode = 1;
+        exporter_start(async_queue, threads);
+    }
+
+    while (fread(&ch, sizeof(ch), 1, f) == 1) {
+        const char * records = buf;
+
+        if (ch.len > buf_size) {
+            buf_size = ch.len;
+            buf = realloc(buf, buf_size);
+            if (!buf) enomem();
+            records = buf;
+        }
+        if (fread(buf, 1, ch.len, f) != ch.len) {
+            printf("!!! %s is truncated\n", fname);
             break;
-        case GL_TRIANGLES:
-            do_gl_triangles(f, prim);
+        }
+        if (ch.codec == OGR_ZLIB) {
+            uLongf len = ch.raw_len;
+            if (ch.raw_len > raw_size) {
+                raw_size = ch.raw_len;
+                raw = realloc(raw, raw_size);
+                if (!raw) enomem();
+            }
+            if (uncompress((Bytef *) raw, &len, (Bytef *) buf, ch.len) != Z_OK ||
+                    len != ch.raw_len) {
+                printf("!!! broken chunk of segment %u, skipped\n", ch.segment);
+                ret = -1;
+                continue;
+            }
+            records = raw;
+        } else if (ch.codec != OGR_STORED || ch.len != ch.raw_len) {
+            printf("!!! chunk of segment %u has unknown codec %u, skipped\n",
+                    ch.segment, ch.codec);
+            ret = -1;
+            continue;
+        }
+
+        for (link = &segments; *link; link = &(*link)->next)
+            if ((*link)->id == ch.segment)
+                break;
+        s = *link;
+        if (!s) {
+            s = calloc(1, sizeof(*s));
+            if (!s) enomem();
+            s->id  = ch.segment;
+            s->cap = capture_new();
+            *link  = s;
+        }
+        switch (replay_records(s, records, ch.raw_len)) {
+            case 1:
+                *link = s->next;
+                replay_export(s);
+                break;
+            case -1:
+                printf("!!! broken records in segment %u\n", ch.segment);
+                ret = -1;
+                break;
+        }
+    }
+    fclose(f);
+
+    /* the traced process didn't finish these */
+    while ((s = segments)) {
+        printf("!!! segment %u is incomplete, converting what's there\n", s->id);
+        segments = s->next;
+        replay_export(s);
+    }
+    if (async_mode)
+        exporter_stop();
+    containers_close();
+    gltf_finish();
+    mesh_manifest();
+    free(buf);
+    free(raw);
+    return ret;
+}
+
+/**************************************************************/
+/* tracing                                                    */
+/* verbprintf() only stores the format and the raw arguments  */
+/* in a lock-free ring, a tracer thread does the formatting   */
+/* and the writing. when the ring is full records are dropped */
+/* rather than stalling the application.                      */
+
+#define TRACE_RING_DEFAULT (64 * 1024)
+#define TRACE_ARGS 8
+
+int trace_level = TRACE_OFF;
+
+union trace_arg_t {
+    int64_t      i;
+    double       d;
+    const void * p;
+};
+
+struct trace_rec_t {
+    uint32_t          seq;
+    const char      * fmt;
+    union trace_arg_t a[TRACE_ARGS];
+};
+
+struct trace_ring_t {
+    struct trace_rec_t * ring;
+    uint32_t             mask;
+    uint32_t             head;    /* next record the tracer formats */
+    uint32_t             tail;    /* next record a wrapper fills */
+    uint32_t             dropped;
+    int                  quit;
+    pthread_t            thread;
+} trace_ring;
+
+/* skip flags, width, precision and length of a conversion. */
+/* returns the conversion character, *lng is set for %l, %z */
+static inline char trace_conv(const char ** f, int * lng)
+{
+    const char * p = *f;
+
+    *lng = 0;
+    while (*p && strchr("-+ #0123456789.", *p))
+        p++;
+    while (*p && strchr("hlzjt", *p)) {
+        if (*p != 'h')
+            *lng = 1;
+        p++;
+    }
+    *f = p;
+    return *p;
+}
+
+void trace_rec(const char * fmt, ...)
+{
+    struct trace_ring_t * t = &trace_ring;
+    struct trace_rec_t  * r;
+    uint32_t pos = __atomic_load_n(&t->tail, __ATOMIC_RELAXED);
+    const char * f;
+    va_list ap;
+    int i, lng;
+
+    for (;;) {
+        r = &t->ring[pos & t->mask];
+        int32_t dif = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) - pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&t->tail, &pos, pos + 1, 1,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            __atomic_fetch_add(&t->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&t->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    r->fmt = fmt;
+    va_start(ap, fmt);
+    for (f=fmt, i=0; *f && i<TRACE_ARGS; f++) {
+        if (*f != '%')
+            continue;
+        f++;
+        switch (trace_conv(&f, &lng)) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'c':
+                r->a[i++].i = lng ? va_arg(ap, long) : va_arg(ap, int);
+                break;
+            case 'f': case 'e': case 'E': case 'g': case 'G':
+                r->a[i++].d = va_arg(ap, double);
+                break;
+            case 's': case 'p':
+                r->a[i++].p = va_arg(ap, const void *);
+                break;
+            case '\0':
+                f--;
+                break;
+        }
+    }
+    va_end(ap);
+    __atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/* printf() one record, one conversion at a time */
+void trace_format(FILE * out, struct trace_rec_t * r)
+{
+    char spec[32];
+    const char * f = r->fmt;
+    const char * start;
+    int i = 0, lng;
+    char c;
+
+    while (*f) {
+        if (*f != '%') {
+            fputc(*f++, out);
+            continue;
+        }
+        start = f++;
+        c = trace_conv(&f, &lng);
+        if (!c)
             break;
-        case GL_TRIANGLE_STRIP:
-            do_gl_triangle_strip(f, prim);
-        case GL_TRIANGLE_FAN:
-        case GL_POLYGON:
-            do_gl_triangle_fan(f, prim);
+        f++;
+        if (c == '%') {
+            fputc('%', out);
+            continue;
+        }
+        if (f - start >= sizeof(spec) || i >= TRACE_ARGS)
             break;
-#endif
-#if 0
-        case GL_LINE_LOOP:
-            do_gl_triangle_fan(f, prim);
+        memcpy(spec, start, f - start);
+        spec[f - start] = 0;
+        switch (c) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'c':
+                if (lng)
+                    fprintf(out, spec, (long)r->a[i++].i);
+                else
+                    fprintf(out, spec, (int)r->a[i++].i);
+                break;
+            case 'f': case 'e': case 'E': case 'g': case 'G':
+                fprintf(out, spec, r->a[i++].d);
+                break;
+            case 's':
+            case 'p':
+                fprintf(out, spec, r->a[i++].p);
+                break;
+        }
+    }
+}
+
+int trace_drain(void)
+{
+    struct trace_ring_t * t = &trace_ring;
+    struct trace_rec_t  * r;
+    int n = 0;
+
+    for (;;) {
+        r = &t->ring[t->head & t->mask];
+        if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != t->head + 1)
             break;
-#endif
-        default:
-            printf("!!! FIXME implement gl_primitive type 0x%4.4x / %s\n",
-                    prim->type, prim_type_name[prim->type]);
+        trace_format(stdout, r);
+        __atomic_store_n(&r->seq, t->head + t->mask + 1, __ATOMIC_RELEASE);
+        t->head++;
+        n++;
     }
-    fixup_stl(f, n_stl_triangles);
-    fclose(f);
+    return n;
 }
 
-void do_file_DrawElements(int n, struct drawelements_t * p)
+void * trace_thread(void * arg)
 {
-    char fnamebuf[256];
-    sprintf(fnamebuf, "%s/drawelements_%.7d.stl", FNAME_PREFIX, n);
-    FILE * f = fopen(fnamebuf, "wb");
-    if (!f) {
-        printf("!!! couldn't fopen(%s)\n", fnamebuf);
+    struct timespec ts = { 0, 1000000 };
+
+    while (!__atomic_load_n(&trace_ring.quit, __ATOMIC_ACQUIRE)) {
+        if (!trace_drain()) {
+            fflush(stdout);
+            nanosleep(&ts, NULL);
+        }
+    }
+    trace_drain();
+    fflush(stdout);
+    return NULL;
+}
+
+void trace_start(int level, uint32_t ring_size)
+{
+    uint32_t size = 1, i;
+
+    while (size < ring_size)
+        size <<= 1;
+    trace_ring.ring = calloc(size, sizeof(*trace_ring.ring));
+    if (!trace_ring.ring) enomem();
+    for (i=0; i<size; i++)
+        trace_ring.ring[i].seq = i;
+    trace_ring.mask = size - 1;
+    if (pthread_create(&trace_ring.thread, NULL, trace_thread, NULL)) {
+        printf("!!! couldn't start tracer thread, tracing is off\n");
         return;
     }
+    trace_level = level;
+    printf("+++ tracing at level %d, ring of %d records\n", level, size);
+}
 
-    fwrite(stl_header, 1, 80, f);
+void trace_stop(void)
+{
+    if (trace_level == TRACE_OFF)
+        return;
+    trace_level = TRACE_OFF;
+    __atomic_store_n(&trace_ring.quit, 1, __ATOMIC_RELEASE);
+    pthread_join(trace_ring.thread, NULL);
+    if (trace_ring.dropped)
+        printf("!!! tracer dropped %d records, raise OGLDUMP_TRACE_RING\n",
+                trace_ring.dropped);
+}
+
+/**************************************************************/
+/* capture triggers                                           */
+/* a capture covers whole frames. triggers only ask for one,  */
+/* glXSwapBuffers() starts and stops it, so recording is never */
+/* switched on or off in the middle of a frame.                */
 
-    int vertices = 0; /* will be written again by fixup_stl() */
-    fwrite(&vertices, 4, 1, f);
+/* the capture trigger commands of the control socket */
+void control_command(char * cmd, char * reply, size_t len)
+{
+    char * arg;
+
+    cmd[strcspn(cmd, "\r\n")] = 0;
+    arg = strchr(cmd, ' ');
+    if (arg)
+        *arg++ = 0;
+
+    if (!strcmp(cmd, "start")) {
+        uint32_t frames = arg ? strtoul(arg, NULL, 0) : 0;
+        capture_trigger(frames ? frames : capture_frames);
+        snprintf(reply, len, "ok\n");
+    } else if (!strcmp(cmd, "stop")) {
+        capture_stop();
+        snprintf(reply, len, "ok\n");
+    } else if (!strcmp(cmd, "status")) {
+        snprintf(reply, len, "%s, %u frames left, %u captured\n",
+                ring_frames ? "flight recorder" :
+                (capturing & CAPTURE_FRAMES) ? "capturing" : "idle",
+                __atomic_load_n(&frames_left, __ATOMIC_RELAXED),
+                __atomic_load_n(&nFrames, __ATOMIC_RELAXED));
+    } else {
+        snprintf(reply, len, "unknown command, try start [frames], stop or status\n");
+    }
+}
 
-    int n_drawelements = 0;
-    void * pv = p->vertexpointer->ptr_copy;
+/* one command per connection */
+void * control_thread(void * arg)
+{
+    int fd = (int)(intptr_t) arg;
+    char cmd[64], reply[128];
+
+    for (;;) {
+        int c = accept(fd, NULL, NULL);
+        if (c < 0) {
+            if (errno == EINTR)
+                continue;
+            printf("!!! control socket: %s\n", strerror(errno));
+            return NULL;
+        }
+        ssize_t n = read(c, cmd, sizeof(cmd) - 1);
+        if (n > 0) {
+            cmd[n] = 0;
+            control_command(cmd, reply, sizeof(reply));
+            if (write(c, reply, strlen(reply)) < 0)
+                ; /* the client went away, nothing to do */
+        }
+        close(c);
+    }
+}
 
-    switch (p->mode) {
-        case GL_TRIANGLES:
-            {
-                struct triangle_t t;
-                int stride  = p->vertexpointer->stride / 4;
-                uint16_t * ind16 = p->indices;
-                uint32_t * ind32 = p->indices;
-                int i;
-                for (i=0; i<p->count ; i+=3) {
-
-                    t.xn = p->norm->v.x;
-                    t.yn = p->norm->v.y;
-                    t.zn = p->norm->v.z;
-
-                    switch (p->type){
-                        case GL_UNSIGNED_SHORT:
-                            t.x1 = ((float *)pv)[0 + stride * ind16[i+0]];
-                            t.y1 = ((float *)pv)[1 + stride * ind16[i+0]];
-                            t.z1 = ((float *)pv)[2 + stride * ind16[i+0]];
-                            t.x2 = ((float *)pv)[0 + stride * ind16[i+1]];
-                            t.y2 = ((float *)pv)[1 + stride * ind16[i+1]];
-                            t.z2 = ((float *)pv)[2 + stride * ind16[i+1]];
-                            t.x3 = ((float *)pv)[0 + stride * ind16[i+2]];
-                            t.y3 = ((float *)pv)[1 + stride * ind16[i+2]];
-                            t.z3 = ((float *)pv)[2 + stride * ind16[i+2]];
-                            break;
-                        case GL_UNSIGNED_INT:
-                            t.x1 = ((float *)pv)[0 + stride * ind32[i+0]];
-                            t.y1 = ((float *)pv)[1 + stride * ind32[i+0]];
-                            t.z1 = ((float *)pv)[2 + stride * ind32[i+0]];
-                            t.x2 = ((float *)pv)[0 + stride * ind32[i+1]];
-                            t.y2 = ((float *)pv)[1 + stride * ind32[i+1]];
-                            t.z2 = ((float *)pv)[2 + stride * ind32[i+1]];
-                            t.x3 = ((float *)pv)[0 + stride * ind32[i+2]];
-                            t.y3 = ((float *)pv)[1 + stride * ind32[i+2]];
-                            t.z3 = ((float *)pv)[2 + stride * ind32[i+2]];
-                            break;
-                        default:
-                            printf("!!! FIXME: support DrawElements() type 0x%4.4x\n",
-                                    p->type);
-                    }
-
-                    n_drawelements++;
-                    emit_stl_triangle(f, t);
+char        control_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+struct stat control_stat; /* of our socket, see control_stop() */
+
+/* path with %p replaced by the pid, 0 if it doesn't fit */
+int control_expand(char * out, size_t size, const char * path)
+{
+    size_t n = 0;
+    int len;
+
+    for (; *path; path++) {
+        if (path[0] == '%' && path[1] == 'p') {
+            len = snprintf(out + n, size - n, "%d", (int) getpid());
+            if (len < 0 || (size_t) len >= size - n)
+                return 0;
+            n += len;
+            path++;
+            continue;
+        }
+        if (n + 1 >= size)
+            return 0;
+        out[n++] = *path;
+    }
+    out[n] = 0;
+    return 1;
+}
+
+/* a socket left at path by a process that's gone is removed, */
+/* 0 if another one is listening there or it's not a socket   */
+int control_claim(const struct sockaddr_un * addr)
+{
+    struct stat st;
+    int fd, ret;
+
+    if (lstat(addr->sun_path, &st) < 0)
+        return errno == ENOENT;
+    if (!S_ISSOCK(st.st_mode)) {
+        printf("!!! %s is not a socket, leaving it alone\n", addr->sun_path);
+        return 0;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+        return 0;
+    ret = connect(fd, (const struct sockaddr *) addr, sizeof(*addr));
+    close(fd);
+    if (ret == 0 || errno != ECONNREFUSED) {
+        printf("!!! %s is in use, put %%p in OGLDUMP_CONTROL for the pid\n",
+                addr->sun_path);
+        return 0;
+    }
+    unlink(addr->sun_path);
+    return 1;
+}
+
+void control_start(char * path)
+{
+    struct sockaddr_un addr;
+    pthread_t tid;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (!control_expand(addr.sun_path, sizeof(addr.sun_path), path)) {
+        printf("!!! control socket path too long: %s\n", path);
+        return;
+    }
+    if (!control_claim(&addr))
+        return;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        printf("!!! couldn't create control socket: %s\n", strerror(errno));
+        return;
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+            listen(fd, 4) < 0) {
+        printf("!!! couldn't listen on %s: %s\n", addr.sun_path, strerror(errno));
+        close(fd);
+        return;
+    }
+    if (pthread_create(&tid, NULL, control_thread, (void *)(intptr_t) fd)) {
+        printf("!!! couldn't start control thread\n");
+        close(fd);
+        unlink(addr.sun_path);
+        return;
+    }
+    pthread_detach(tid);
+    lstat(addr.sun_path, &control_stat);
+    strcpy(control_path, addr.sun_path);
+    printf("+++ listening for commands on %s\n", control_path);
+}
+
+/* at exit, the socket is removed unless it was replaced since */
+void control_stop(void)
+{
+    struct stat st;
+
+    if (!control_path[0])
+        return;
+    if (lstat(control_path, &st) == 0 && st.st_ino == control_stat.st_ino &&
+            st.st_dev == control_stat.st_dev)
+        unlink(control_path);
+}
+
+/**************************************************************/
+/* options                                                    */
+/* every setting is in this table. they are read once, when   */
+/* ogldump is loaded: the built in defaults, then the config  */
+/* file, then the environment. a value that doesn't parse or  */
+/* is out of range is reported and the previous one is kept.  */
+
+#define CONFIG_DEFAULT ".ogldumprc" /* in $HOME */
+
+int      dump_instant  = 0;
+char   * control_request = NULL; /* socket to listen on */
+uint32_t trace_request = TRACE_OFF;
+uint32_t trace_ring_size = TRACE_RING_DEFAULT;
+
+enum opt_type_t {
+    OPT_BOOL,   /* int, 0/1, no/yes, off/on, false/true */
+    OPT_UINT,   /* uint32_t */
+    OPT_SIZE,   /* size_t, with an optional k, M or G */
+    OPT_STRING, /* char * */
+    OPT_ENUM,   /* int, index into choices */
+};
+
+struct option_t {
+    const char *          name; /* OGLDUMP_<name>, or <name> in the file */
+    enum opt_type_t       type;
+    void *                var;
+    uint64_t              min;
+    uint64_t              max;
+    const char * const *  choices;
+};
+
+struct option_t options[] = {
+    { "DIR",          OPT_STRING, &FNAME_PREFIX,     0, 0, NULL },
+    { "FORMAT",       OPT_ENUM,   &output_format,    0, 0, format_names },
+    { "FRAMES",       OPT_UINT,   &capture_frames,   1, 1 << 20, NULL },
+    { "DUMP_COUNT",   OPT_UINT,   &dump_count,       0, UINT32_MAX, NULL },
+    { "DUMP_INSTANT", OPT_BOOL,   &dump_instant,     0, 1, NULL },
+    { "CONTROL",      OPT_STRING, &control_request,  0, 0, NULL },
+    { "ARENA_SIZE",   OPT_SIZE,   &arena_chunk_size, 4096, 1 << 30, NULL },
+    { "ASYNC",        OPT_BOOL,   &async_mode,       0, 1, NULL },
+    { "ASYNC_QUEUE",  OPT_UINT,   &async_queue,      1, 1 << 16, NULL },
+    { "ASYNC_BATCH",  OPT_SIZE,   &async_batch,      4096, (uint64_t) 1 << 40, NULL },
+    { "THREADS",      OPT_UINT,   &export_threads,   1, EXPORT_THREADS_MAX, NULL },
+    { "RAW_COMPRESS", OPT_UINT,   &raw_compress,     0, 9, NULL },
+    { "DEDUP",        OPT_BOOL,   &dedup_mode,       0, 1, NULL },
+    { "RING",         OPT_UINT,   &ring_frames,      0, 1 << 12, NULL },
+    { "RING_SIZE",    OPT_SIZE,   &ring_size,        1 << 20, (uint64_t) 1 << 40, NULL },
+    { "RING_CONTEXTS", OPT_UINT,  &ring_contexts,    1, 1 << 10, NULL },
+    { "TRACE",        OPT_UINT,   &trace_request,    TRACE_OFF, TRACE_CALLS, NULL },
+    { "TRACE_RING",   OPT_UINT,   &trace_ring_size,  64, 1 << 24, NULL },
+};
+
+#define N_OPTIONS (sizeof(options) / sizeof(options[0]))
+
+struct option_t * option_find(const char * name)
+{
+    int i;
+
+    if (!strncasecmp(name, "OGLDUMP_", 8))
+        name += 8;
+    for (i=0; i<N_OPTIONS; i++)
+        if (!strcasecmp(options[i].name, name))
+            return &options[i];
+    return NULL;
+}
+
+/* 0 if value is good for o, o's variable is only touched then */
+int option_set(struct option_t * o, const char * value)
+{
+    unsigned long long u;
+    char * end;
+    int i;
+
+    switch (o->type) {
+        case OPT_BOOL:
+            if (!strcmp(value, "1") || !strcasecmp(value, "yes") ||
+                    !strcasecmp(value, "on") || !strcasecmp(value, "true"))
+                *(int *) o->var = 1;
+            else if (!strcmp(value, "0") || !strcasecmp(value, "no") ||
+                    !strcasecmp(value, "off") || !strcasecmp(value, "false"))
+                *(int *) o->var = 0;
+            else
+                return -1;
+            return 0;
+        case OPT_UINT:
+        case OPT_SIZE:
+            if (!isdigit((unsigned char) *value))
+                return -1;
+            errno = 0;
+            u = strtoull(value, &end, 0);
+            if (errno)
+                return -1;
+            if (o->type == OPT_SIZE && *end) {
+                int shift = 0;
+                switch (*end++) {
+                    case 'k': case 'K': shift = 10; break;
+                    case 'm': case 'M': shift = 20; break;
+                    case 'g': case 'G': shift = 30; break;
+                    default: return -1;
                 }
-                n++;
-                break;
-            } 
-        default:
-            // FIXME
-            printf("!!! FIXME implement DrawElements() mode %d\n", p->mode);
+                if (u > (ULLONG_MAX >> shift))
+                    return -1;
+                u <<= shift;
+            }
+            if (*end || u < o->min || u > o->max)
+                return -1;
+            if (o->type == OPT_UINT)
+                *(uint32_t *) o->var = u;
+            else
+                *(size_t *) o->var = u;
+            return 0;
+        case OPT_STRING:
+            if (!*value)
+                return -1;
+            *(char **) o->var = strdup(value);
+            if (!*(char **) o->var) enomem();
+            return 0;
+        case OPT_ENUM:
+            for (i=0; o->choices[i]; i++) {
+                if (!strcasecmp(o->choices[i], value)) {
+                    *(int *) o->var = i;
+                    return 0;
+                }
+            }
+            return -1;
+    }
+    return -1;
+}
+
+void option_print_range(struct option_t * o)
+{
+    int i;
+
+    switch (o->type) {
+        case OPT_BOOL:
+            printf("0 or 1");
+            break;
+        case OPT_UINT:
+        case OPT_SIZE:
+            printf("%llu to %llu", (unsigned long long) o->min,
+                    (unsigned long long) o->max);
+            break;
+        case OPT_STRING:
+            printf("not empty");
+            break;
+        case OPT_ENUM:
+            for (i=0; o->choices[i]; i++)
+                printf("%s%s", i ? ", " : "one of ", o->choices[i]);
+            break;
+    }
+}
+
+void option_apply(struct option_t * o, const char * value, const char * from)
+{
+    if (option_set(o, value) < 0) {
+        printf("!!! %s: OGLDUMP_%s=\"%s\" ignored, must be ", from, o->name, value);
+        option_print_range(o);
+        printf("\n");
+        return;
     }
+    printf("+++ %s: OGLDUMP_%s=%s\n", from, o->name, value);
+}
+
+/* lines of "name = value", # starts a comment */
+void options_file(const char * fname, int must_exist)
+{
+    char line[1024];
+    int  lineno = 0;
+    FILE * f = fopen(fname, "r");
 
-    printf("+++ drawelement %d has %d triangles\n", n, n_stl_triangles);
-    fixup_stl(f, n_drawelements);
+    if (!f) {
+        if (must_exist || errno != ENOENT)
+            printf("!!! couldn't open config file %s: %s\n", fname, strerror(errno));
+        return;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char * name, * value, * end;
+        struct option_t * o;
+
+        lineno++;
+        if ((end = strchr(line, '#')))
+            *end = 0;
+        for (name = line; isspace((unsigned char) *name); name++)
+            ;
+        if (!*name)
+            continue;
+        value = strchr(name, '=');
+        if (!value) {
+            printf("!!! %s:%d: expected name = value\n", fname, lineno);
+            continue;
+        }
+        for (end = value; end > name && isspace((unsigned char) end[-1]); end--)
+            ;
+        *end = 0;
+        for (value++; isspace((unsigned char) *value); value++)
+            ;
+        for (end = value + strlen(value); end > value && isspace((unsigned char) end[-1]); end--)
+            ;
+        *end = 0;
+
+        o = option_find(name);
+        if (!o) {
+            printf("!!! %s:%d: unknown option %s\n", fname, lineno, name);
+            continue;
+        }
+        option_apply(o, value, fname);
+    }
     fclose(f);
 }
 
-void do_DrawElements(void)
+/* OGLDUMP_CONFIG names the config file, otherwise ~/.ogldumprc */
+/* is read if it exists.                                        */
+void options_load(void)
 {
-    struct drawelements_t * p = all_drawelements;
-    int n = 0;
-    while (p) {
-        //		printf("+++ writing DrawElement %d\n", n);
-        do_file_DrawElements(n, p);
-        n++;
-        p = p->next;
+    char fname[PATH_MAX];
+    const char * home;
+    int i;
+
+    if (getenv("OGLDUMP_CONFIG")) {
+        options_file(getenv("OGLDUMP_CONFIG"), 1);
+    } else if ((home = getenv("HOME"))) {
+        snprintf(fname, sizeof(fname), "%s/" CONFIG_DEFAULT, home);
+        options_file(fname, 0);
+    }
+
+    for (i=0; i<N_OPTIONS; i++) {
+        char env[64];
+
+        snprintf(env, sizeof(env), "OGLDUMP_%s", options[i].name);
+        if (getenv(env))
+            option_apply(&options[i], getenv(env), "environment");
     }
-    printf("+++ wrote a total of %d DrawElements\n", n);
 }
 
 /**************************************************************/
@@ -864,29 +5561,56 @@ void do_DrawElements(void)
 void ogldump_exit(void)
 {
 
+    trace_stop();
+
     printf("+++ ogldump report\n");
 
     printf("+++ got %d prims\n", nPrim);
 
-    int n=0;
-    int large=0;
-    struct prim_t * p = all_prims;
-    while (p) {
-        //		if (p->nV3 > 256) {
-        if (p->nV3 > 8) {
-            //		if (p->nV3 > 0) {
-            printf("+++ prim %d has %d vertices\n", n, p->nV3);
-            large++;
-            //dump_prim(n, p);
-            switch_gl_primitive(n, p);
+    /* threads still drawing at this point are not waited for */
+    uint32_t unfrozen = __atomic_load_n(&ring_discarded, __ATOMIC_RELAXED);
+    struct recorder_t * r = __atomic_load_n(&all_recorders, __ATOMIC_ACQUIRE);
+    for (; r; r = r->next) {
+        dlist_end(r); /* a list still being compiled */
+        if (ring_frames)
+            continue;
+        if (async_mode) {
+            capture_flush(r);
+        } else {
+            capture_export(r->cap);
+            capture_release(r->cap);
+            r->cap = capture_new();
         }
-        n++;
-        p = p->next;
     }
+    if (ring_frames) {
+        struct ring_t * g;
+        pthread_mutex_lock(&rings_lock);
+        for (g = all_rings; g; g = g->next)
+            unfrozen += g->count; /* nothing asked for them */
+        pthread_mutex_unlock(&rings_lock);
+    }
+    if (async_mode)
+        exporter_stop();
+    containers_close();
+    raw_close();
+    gltf_finish();
+    mesh_manifest();
+
+    control_stop();
+
+    printf("+++ captured %u frames\n", nFrames);
+    printf("+++ arena high water mark %zu bytes\n", arena_high_water);
+    printf("+++ saved %zu bytes by sharing identical arrays\n", dedup_saved);
+    if (ring_frames)
+        printf("+++ flight recorder discarded %u frames not triggered for\n",
+                unfrozen);
+    if (ring_dropped)
+        printf("!!! flight recorder dropped %u objects, raise OGLDUMP_RING_SIZE\n",
+                ring_dropped);
+    if (ring_lost)
+        printf("!!! flight recorder lost %u frames, the exporter was behind\n",
+                ring_lost);
 
-    do_DrawElements();
-
-    printf("+++ wrote a total of %d prims\n", large);
     printf("+++ byebye from ogldump.\n\n");
 }
 
@@ -894,18 +5618,23 @@ void sig_usr2_handler(int s)
 {
     if (s != SIGUSR2)
         return;
-    dump_count = DUMP_COUNT;
+    capture_trigger(capture_frames);
 }
 
-static int is_initialized = 0;
+int dispatch_total    = 0; /* filled in by dispatch_init() */
+int dispatch_resolved = 0;
 
-static inline void init(void)
+/* run on the first wrapped call that records or keeps state, */
+/* so processes that never draw aren't touched at all          */
+void init_once(void)
 {
-    if (is_initialized)
-        return;
+    options_load();
+    pthread_key_create(&recorder_key, ring_thread_exit);
+
+    printf("+++ resolved %d of %d GL entry points\n",
+            dispatch_resolved, dispatch_total);
+    printf("+++ using %s index range scan\n", index_range.name);
 
-    if (getenv("OGLDUMP_DIR"))
-        FNAME_PREFIX = getenv("OGLDUMP_DIR");
     if (mkdir(FNAME_PREFIX, 0660) < 0)
     {
         if (errno != EEXIST)
@@ -914,30 +5643,38 @@ static inline void init(void)
             exit(1);
         }
     }
-    printf("+++ dumping to dir %s\n", FNAME_PREFIX);
+    printf("+++ dumping %s to dir %s\n", format_names[output_format], FNAME_PREFIX);
 
-    if (getenv("OGLDUMP_DUMP_COUNT"))
+    /* the flight recorder records all the time, else */
+    /* load time is as good a frame boundary as any    */
+    if (ring_frames)
     {
-        DUMP_COUNT = getenv("OGLDUMP_DUMP_COUNT");
+        ring_setup();
     }
-
-    if (getenv("OGLDUMP_DUMP_INSTANT") == 1)
+    else if (dump_instant)
     {
-        dump_count = DUMP_COUNT;
+        nCaptures    = 1;
+        objects_left = dump_count;
+        frames_left  = capture_frames;
+        __atomic_fetch_or(&capturing, CAPTURE_FRAMES, __ATOMIC_RELAXED);
     }
 
-    atexit(ogldump_exit);
+    if (control_request)
+        control_start(control_request);
+
+    if (async_mode)
+        exporter_start(async_queue, export_threads);
+    if (ring_frames && !async_mode)
+    {
+        printf("!!! flight recorder off, it needs the exporter thread\n");
+        ring_frames = 0;
+        __atomic_fetch_and(&capturing, ~CAPTURE_FRAMES, __ATOMIC_RELAXED);
+    }
 
-    all_prims         = NULL;
-    norm              = NULL;
-    norm_last         = NULL;
-    drawelements      = NULL;
-    all_drawelements  = NULL;
-    all_vertexpointer = NULL;
-    vertexpointer     = NULL;
+    if (trace_request > TRACE_OFF)
+        trace_start(trace_request, trace_ring_size);
 
-    /* an initial default normal */
-    new_N3(0.0, 0.0, 1.0);
+    atexit(ogldump_exit);
 
     sighandler_t rets = signal(SIGUSR2, sig_usr2_handler);
     if (rets == SIG_ERR)
@@ -945,11 +5682,20 @@ static inline void init(void)
     else
         printf("+++ installed sig_usr2_handler()\n");
 
-    is_initialized++;
+    __atomic_fetch_and(&capturing, ~CAPTURE_INIT, __ATOMIC_RELEASE);
+}
+
+void init(void)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, init_once);
 }
 
 /**************************************************************/
 /* hijacked functions */
+/* left out when ogldump.c is built into ogldump_convert */
+
+#ifndef OGLDUMP_CONVERT
 
 #if 0
     int __libc_start_main(
@@ -966,22 +5712,6 @@ static inline void init(void)
 }
 #endif
 
-#if 0
-sighandler_t signal(int signum, sighandler_t handler)
-{
-    static sighandler_t (*func)(int, sighandler_t) = NULL;
-    if (!func)
-        func = (sighandler_t (*)(int, sighandler_t)) dlsym(RTLD_NEXT, "signal");
-
-    if (signum == SIGUSR2)
-    {
-        printf("+++ recording %d OpenGL calls\n", DUMP_COUNT);
-        init();
-        dump_count = DUMP_COUNT;
-    }else
-        return func(signum, handler);
-}
-#endif
 
 
 //#define DO_2D_VERTEX
@@ -989,653 +5719,1050 @@ sighandler_t signal(int signum, sighandler_t handler)
 //#define DO_4D_VERTEX
 #define DO_3D_NORMAL /* should alway be on */
 #define DO_DRAW_ELEMENTS
+#define DO_BUFFER_OBJECTS
+#define DO_MATRIX_STACK
+#define DO_DISPLAY_LISTS
 
 #define glvoid __attribute__((visibility("default"))) void
 
-#if 0
+/* every wrapped entry point, as X(return type, name, arguments). */
+/* the real functions are looked up when ogldump is loaded, and   */
+/* again on their first call if that failed, see REAL().          */
+#define GL_FUNCS(X) \
+    X(void, glNewList, (GLuint, GLenum)) \
+    X(void, glEndList, (void)) \
+    X(void, glCallList, (GLuint)) \
+    X(void, glCallLists, (GLsizei, GLenum, const GLvoid *)) \
+    X(void, glListBase, (GLuint)) \
+    X(void, glDeleteLists, (GLuint, GLsizei)) \
+    X(void, glBegin, (GLenum)) \
+    X(void, glEnd, (void)) \
+    GL_FUNCS_2D_VERTEX(X) \
+    X(void, glVertex3d, (GLdouble, GLdouble, GLdouble)) \
+    X(void, glVertex3f, (GLfloat, GLfloat, GLfloat)) \
+    X(void, glVertex3i, (GLint, GLint, GLint)) \
+    X(void, glVertex3s, (GLshort, GLshort, GLshort)) \
+    GL_FUNCS_4D_VERTEX(X) \
+    X(void, glVertex3dv, (const GLdouble *)) \
+    X(void, glVertex3fv, (const GLfloat *)) \
+    X(void, glVertex3iv, (const GLint *)) \
+    X(void, glVertex3sv, (const GLshort *)) \
+    X(void, glNormal3b, (GLbyte, GLbyte, GLbyte)) \
+    X(void, glNormal3d, (GLdouble, GLdouble, GLdouble)) \
+    X(void, glNormal3f, (GLfloat, GLfloat, GLfloat)) \
+    X(void, glNormal3i, (GLint, GLint, GLint)) \
+    X(void, glNormal3s, (GLshort, GLshort, GLshort)) \
+    X(void, glNormal3bv, (const GLbyte *)) \
+    X(void, glNormal3dv, (const GLdouble *)) \
+    X(void, glNormal3fv, (const GLfloat *)) \
+    X(void, glNormal3iv, (const GLint *)) \
+    X(void, glNormal3sv, (const GLshort *)) \
+    X(void, glVertexPointer, (GLint, GLenum, GLsizei, const GLvoid *)) \
+    X(void, glNormalPointer, (GLenum, GLsizei, const GLvoid *)) \
+    X(void, glTexCoordPointer, (GLint, GLenum, GLsizei, const GLvoid *)) \
+    X(void, glColorPointer, (GLint, GLenum, GLsizei, const GLvoid *)) \
+    X(void, glInterleavedArrays, (GLenum, GLsizei, const GLvoid *)) \
+    X(void, glEnableClientState, (GLenum)) \
+    X(void, glDisableClientState, (GLenum)) \
+    X(void, glDrawElements, (GLenum, GLsizei, GLenum, const GLvoid *)) \
+    X(void, glDrawArrays, (GLenum, GLint, GLsizei)) \
+    X(void, glDrawRangeElements, (GLenum, GLuint, GLuint, GLsizei, GLenum, const GLvoid *)) \
+    X(void, glMultiDrawArrays, (GLenum, const GLint *, const GLsizei *, GLsizei)) \
+    X(void, glMultiDrawElements, (GLenum, const GLsizei *, GLenum, const GLvoid * const *, GLsizei)) \
+    X(void, glXSwapBuffers, (Display *, GLXDrawable)) \
+    X(Bool, glXMakeCurrent, (Display *, GLXDrawable, GLXContext)) \
+    X(Bool, glXMakeContextCurrent, (Display *, GLXDrawable, GLXDrawable, GLXContext)) \
+    X(__GLXextFuncPtr, glXGetProcAddress, (const GLubyte *)) \
+    X(__GLXextFuncPtr, glXGetProcAddressARB, (const GLubyte *)) \
+    X(void, glMatrixMode, (GLenum)) \
+    X(void, glLoadIdentity, (void)) \
+    X(void, glLoadMatrixf, (const GLfloat *)) \
+    X(void, glLoadMatrixd, (const GLdouble *)) \
+    X(void, glMultMatrixf, (const GLfloat *)) \
+    X(void, glMultMatrixd, (const GLdouble *)) \
+    X(void, glTranslatef, (GLfloat, GLfloat, GLfloat)) \
+    X(void, glTranslated, (GLdouble, GLdouble, GLdouble)) \
+    X(void, glRotatef, (GLfloat, GLfloat, GLfloat, GLfloat)) \
+    X(void, glRotated, (GLdouble, GLdouble, GLdouble, GLdouble)) \
+    X(void, glScalef, (GLfloat, GLfloat, GLfloat)) \
+    X(void, glScaled, (GLdouble, GLdouble, GLdouble)) \
+    X(void, glPushMatrix, (void)) \
+    X(void, glPopMatrix, (void)) \
+    X(void, glGenBuffers, (GLsizei, GLuint *)) \
+    X(void, glGenBuffersARB, (GLsizei, GLuint *)) \
+    X(void, glDeleteBuffers, (GLsizei, const GLuint *)) \
+    X(void, glDeleteBuffersARB, (GLsizei, const GLuint *)) \
+    X(void, glBindBuffer, (GLenum, GLuint)) \
+    X(void, glBindBufferARB, (GLenum, GLuint)) \
+    X(void, glBufferData, (GLenum, GLsizeiptr, const GLvoid *, GLenum)) \
+    X(void, glBufferDataARB, (GLenum, GLsizeiptrARB, const GLvoid *, GLenum)) \
+    X(void, glBufferSubData, (GLenum, GLintptr, GLsizeiptr, const GLvoid *)) \
+    X(void, glBufferSubDataARB, (GLenum, GLintptrARB, GLsizeiptrARB, const GLvoid *)) \
+    X(void *, glMapBuffer, (GLenum, GLenum)) \
+    X(void *, glMapBufferARB, (GLenum, GLenum)) \
+    X(void *, glMapBufferRange, (GLenum, GLintptr, GLsizeiptr, GLbitfield)) \
+    X(GLboolean, glUnmapBuffer, (GLenum)) \
+    X(GLboolean, glUnmapBufferARB, (GLenum)) \
+    /* end of GL_FUNCS */
+
+/* the vertex calls that are only wrapped when enabled above */
+#ifdef DO_2D_VERTEX
+#define GL_FUNCS_2D_VERTEX(X) \
+    X(void, glVertex2d, (GLdouble, GLdouble)) \
+    X(void, glVertex2f, (GLfloat, GLfloat)) \
+    X(void, glVertex2i, (GLint, GLint)) \
+    X(void, glVertex2s, (GLshort, GLshort)) \
+    X(void, glVertex2dv, (const GLdouble *)) \
+    X(void, glVertex2fv, (const GLfloat *)) \
+    X(void, glVertex2iv, (const GLint *)) \
+    X(void, glVertex2sv, (const GLshort *))
+#else
+#define GL_FUNCS_2D_VERTEX(X)
+#endif
+#ifdef DO_4D_VERTEX
+#define GL_FUNCS_4D_VERTEX(X) \
+    X(void, glVertex4d, (GLdouble, GLdouble, GLdouble, GLdouble)) \
+    X(void, glVertex4f, (GLfloat, GLfloat, GLfloat, GLfloat)) \
+    X(void, glVertex4i, (GLint, GLint, GLint, GLint)) \
+    X(void, glVertex4s, (GLshort, GLshort, GLshort, GLshort)) \
+    X(void, glVertex4dv, (const GLdouble *)) \
+    X(void, glVertex4fv, (const GLfloat *)) \
+    X(void, glVertex4iv, (const GLint *)) \
+    X(void, glVertex4sv, (const GLshort *))
+#else
+#define GL_FUNCS_4D_VERTEX(X)
+#endif
+
+struct gl_dispatch_t {
+#define X(ret, name, args) ret (*name) args;
+    GL_FUNCS(X)
+#undef X
+} real;
+
+void * dispatch_lookup(const char * name)
+{
+    __GLXextFuncPtr (*gpa)(const GLubyte *);
+    void * p = dlsym(RTLD_NEXT, name);
+
+    /* extension entry points may only be reachable through this */
+    if (!p) {
+        gpa = (__GLXextFuncPtr (*)(const GLubyte *))
+            dlsym(RTLD_NEXT, "glXGetProcAddressARB");
+        if (gpa)
+            p = (void *) gpa((const GLubyte *) name);
+    }
+    return p;
+}
+
+/* looks name up again and stores it in slot, NULL if no library */
+/* has it. libGL may have been dlopen()ed after ogldump's load.  */
+void * dispatch_find(const char * name, void ** slot)
+{
+    void * p = dispatch_lookup(name);
+    if (p)
+        __atomic_store_n(slot, p, __ATOMIC_RELAXED);
+    return p;
+}
+
+/* the cold path of REAL() */
+void * dispatch_resolve(const char * name, void ** slot)
+{
+    void * p = dispatch_find(name, slot);
+    if (!p) {
+        printf("!!! %s was called but no loaded library has it\n", name);
+        fflush(stdout);
+        abort();
+    }
+    return p;
+}
+
+/* calls the real function, looked up again while it's unresolved */
+#define REAL(name) (*({ \
+        __typeof__(real.name) f_ = __atomic_load_n(&real.name, __ATOMIC_RELAXED); \
+        if (__builtin_expect(!f_, 0)) \
+            f_ = (__typeof__(real.name)) dispatch_resolve(#name, (void **) &real.name); \
+        f_; }))
+
+/* the real function or NULL, for the calls that can go without */
+#define REAL_FIND(name) ({ \
+        __typeof__(real.name) f_ = __atomic_load_n(&real.name, __ATOMIC_RELAXED); \
+        if (!f_) \
+            f_ = (__typeof__(real.name)) dispatch_find(#name, (void **) &real.name); \
+        f_; })
+
+void dispatch_init(void)
+{
+#define X(ret, name, args) \
+    real.name = (ret (*) args) dispatch_lookup(#name); \
+    if (real.name) \
+        dispatch_resolved++; \
+    dispatch_total++;
+    GL_FUNCS(X)
+#undef X
+}
+
+__attribute__((constructor)) void ogldump_load(void)
+{
+    dispatch_init();
+    index_range_init();
+}
+
+#ifdef DO_DISPLAY_LISTS
+/* lists are tracked all the time, they're usually compiled long */
+/* before a capture is triggered                                 */
 glvoid glNewList( GLuint list, GLenum mode )
 {
-    init();
-    static void (*func)(GLuint, GLenum) = NULL;
-    if (!func)
-        func = (void (*)(GLuint, GLenum)) dlsym(RTLD_NEXT, "glNewList");
+    verbprintf(TRACE_PRIMS, "glNewList(%u, 0x%x);\n", list, mode);
+    dlist_new(list, mode);
+
+    REAL(glNewList)(list, mode);
+}
+
+glvoid glEndList( void )
+{
+    verbprintf(TRACE_PRIMS, "glEndList();\n");
+    dlist_end(recorder());
+
+    REAL(glEndList)();
+}
+
+glvoid glCallList( GLuint list )
+{
+    dlist_call(recorder(), list);
+
+    REAL(glCallList)(list);
+}
+
+glvoid glCallLists( GLsizei n, GLenum type, const GLvoid *lists )
+{
+    dlist_call_n(n, type, lists);
+
+    REAL(glCallLists)(n, type, lists);
+}
+
+glvoid glListBase( GLuint base )
+{
+    recorder()->gl->list_base = base;
+
+    REAL(glListBase)(base);
+}
 
-    verbprintf("glNewList(%d, %d);\n", list, mode);
+glvoid glDeleteLists( GLuint list, GLsizei range )
+{
+    dlist_delete(list, range);
 
-    func(list, mode);
+    REAL(glDeleteLists)(list, range);
 }
 #endif
 
 #if defined DO_2D_VERTEX || defined DO_3D_VERTEX || defined DO_4D_VERTEX
 glvoid glBegin( GLenum mode )
 {
-    init();
-    static void (*func)(GLenum) = NULL;
-    if (!func)
-        func = (void (*)(GLenum)) dlsym(RTLD_NEXT, "glBegin");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glBegin(%s);", prim_type_name[mode]);
+        struct recorder_t * r = recorder();
+        r->current_prim = new_prim(mode);
+        r->prim_dropped = !r->current_prim;
 
-        current_prim = new_prim(mode);
-
-        verbprintf(" /* [%d] */\n", nPrim-1);
-        dump_count--;
+        verbprintf(TRACE_PRIMS, "glBegin(%s); /* [%d] */\n",
+                prim_name(mode),
+                r->current_prim ? r->current_prim->n : -1);
     }
 
-    func(mode);
+    REAL(glBegin)(mode);
 }
 
 glvoid glEnd( void )
 {
-    init();
-    static void (*func)(void) = NULL;
-    if (!func)
-        func = (void (*)(void)) dlsym(RTLD_NEXT, "glEnd");
-
-    if (dump_count)
+    /* captures start and stop between frames, never inside a prim */
+    if (dump_on())
     {
-        verbprintf("glEnd();\n");
+        struct recorder_t * r = recorder();
+        r->prim_dropped = 0;
+        if (r->current_prim)
+        {
+            verbprintf(TRACE_PRIMS, "glEnd();\n");
 
-        current_prim = NULL;
-        dump_count--;
+            r->current_prim = NULL;
+            capture_check(r);
+        }
     }
 
-    func();
+    REAL(glEnd)();
 }
 #endif
 
 #ifdef DO_2D_VERTEX
 glvoid glVertex2d( GLdouble x, GLdouble y )
 {
-    init();
-    static void (*func)(GLdouble, GLdouble) = NULL;
-    if (!func)
-        func = (void (*)(GLdouble, GLdouble)) dlsym(RTLD_NEXT, "glVertex2d");
+    verbprintf(TRACE_CALLS, "glVertex2d(%f, %f);\n", x, y);
 
-    verbprintf("glVertex2d(%f, %f);\n", x, y);
-
-    func(x, y);
+    REAL(glVertex2d)(x, y);
 }
 
 glvoid glVertex2f( GLfloat x, GLfloat y )
 {
-    init();
-    static void (*func)(GLfloat, GLfloat) = NULL;
-    if (!func)
-        func = (void (*)(GLfloat, GLfloat)) dlsym(RTLD_NEXT, "glVertex2f");
+    verbprintf(TRACE_CALLS, "glVertex2f(%f, %f);\n", x, y);
 
-    verbprintf("glVertex2f(%f, %f);\n", x, y);
-
-    func(x, y);
+    REAL(glVertex2f)(x, y);
 }
 
 glvoid glVertex2i( GLint x, GLint y )
 {
-    init();
-    static void (*func)(GLint, GLint) = NULL;
-    if (!func)
-        func = (void (*)(GLint, GLint)) dlsym(RTLD_NEXT, "glVertex2i");
+    verbprintf(TRACE_CALLS, "glVertex2i(%d, %d);\n", x, y);
 
-    verbprintf("glVertex2i(%d, %d);\n", x, y);
-
-    func(x, y);
+    REAL(glVertex2i)(x, y);
 }
 
 glvoid glVertex2s( GLshort x, GLshort y )
 {
-    init();
-    static void (*func)(GLshort, GLshort) = NULL;
-    if (!func)
-        func = (void (*)(GLshort, GLshort)) dlsym(RTLD_NEXT, "glVertex2s");
+    verbprintf(TRACE_CALLS, "glVertex2s(%d, %d);\n", x, y);
 
-    verbprintf("glVertex2s(%d, %d);\n", x, y);
-
-    func(x, y);
+    REAL(glVertex2s)(x, y);
 }
 #endif
 
 #ifdef DO_3D_VERTEX
 glvoid glVertex3d( GLdouble x, GLdouble y, GLdouble z )
 {
-    init();
-    static void (*func)(GLdouble, GLdouble, GLdouble) = NULL;
-    if (!func)
-        func = (void (*)(GLdouble, GLdouble, GLdouble)) dlsym(RTLD_NEXT, "glVertex3d");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glVertex3d(%f, %f, %f);\n", x, y, z);
+        verbprintf(TRACE_CALLS, "glVertex3d(%f, %f, %f);\n", x, y, z);
         new_V3(x, y, z);
-        dump_count--;
     }
 
-    func(x, y, z);
+    REAL(glVertex3d)(x, y, z);
 }
 
 glvoid glVertex3f( GLfloat x, GLfloat y, GLfloat z )
 {
-    init();
-    static void (*func)(GLfloat, GLfloat, GLfloat) = NULL;
-    if (!func)
-        func = (void (*)(GLfloat, GLfloat, GLfloat)) dlsym(RTLD_NEXT, "glVertex3f");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glVertex3f(%f, %f, %f);\n", x, y, z);
+        verbprintf(TRACE_CALLS, "glVertex3f(%f, %f, %f);\n", x, y, z);
         new_V3(x, y, z);
-        dump_count--;
     }
 
-    func(x, y, z);
+    REAL(glVertex3f)(x, y, z);
 }
 
 glvoid glVertex3i( GLint x, GLint y, GLint z )
 {
-    init();
-    static void (*func)(GLint, GLint, GLint) = NULL;
-    if (!func)
-        func = (void (*)(GLint, GLint, GLint)) dlsym(RTLD_NEXT, "glVertex3i");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glVertex3i(%d, %d, %d);\n", x, y, z);
+        verbprintf(TRACE_CALLS, "glVertex3i(%d, %d, %d);\n", x, y, z);
         new_V3(x, y, z);
-        dump_count--;
     }
 
-    func(x, y, z);
+    REAL(glVertex3i)(x, y, z);
 }
 
 glvoid glVertex3s( GLshort x, GLshort y, GLshort z )
 {
-    init();
-    static void (*func)(GLshort, GLshort, GLshort) = NULL;
-    if (!func)
-        func = (void (*)(GLshort, GLshort, GLshort)) dlsym(RTLD_NEXT, "glVertex3s");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glVertex3s(%d, %d, %d);\n", x, y, z);
+        verbprintf(TRACE_CALLS, "glVertex3s(%d, %d, %d);\n", x, y, z);
         new_V3(x, y, z);
-        dump_count--;
     }
 
-    func(x, y, z);
+    REAL(glVertex3s)(x, y, z);
 }
 #endif
 
 #ifdef DO_4D_VERTEX
 glvoid glVertex4d( GLdouble x, GLdouble y, GLdouble z, GLdouble w )
 {
-    init();
-    static void (*func)(GLdouble, GLdouble, GLdouble, GLdouble) = NULL;
-    if (!func)
-        func = (void (*)(GLdouble, GLdouble, GLdouble, GLdouble)) dlsym(RTLD_NEXT, "glVertex4d");
+    verbprintf(TRACE_CALLS, "glVertex4d(%f, %f, %f, %f);\n", x, y, z, w);
 
-    verbprintf("glVertex4d(%f, %f, %f, %f);\n", x, y, z, w);
-
-    func(x, y, z, w);
+    REAL(glVertex4d)(x, y, z, w);
 }
 
 glvoid glVertex4f( GLfloat x, GLfloat y, GLfloat z, GLfloat w )
 {
-    init();
-    static void (*func)(GLfloat, GLfloat, GLfloat, GLfloat) = NULL;
-    if (!func)
-        func = (void (*)(GLfloat, GLfloat, GLfloat, GLfloat)) dlsym(RTLD_NEXT, "glVertex4f");
+    verbprintf(TRACE_CALLS, "glVertex4f(%f, %f, %f, %f);\n", x, y, z, w);
 
-    verbprintf("glVertex4f(%f, %f, %f, %f);\n", x, y, z, w);
-
-    func(x, y, z, w);
+    REAL(glVertex4f)(x, y, z, w);
 }
 
 glvoid glVertex4i( GLint x, GLint y, GLint z, GLint w )
 {
-    init();
-    static void (*func)(GLint, GLint, GLint, GLint) = NULL;
-    if (!func)
-        func = (void (*)(GLint, GLint, GLint, GLint)) dlsym(RTLD_NEXT, "glVertex4i");
+    verbprintf(TRACE_CALLS, "glVertex4i(%d, %d, %d, %d);\n", x, y, z, w);
 
-    verbprintf("glVertex4i(%d, %d, %d, %d);\n", x, y, z, w);
-
-    func(x, y, z, w);
+    REAL(glVertex4i)(x, y, z, w);
 }
 
 glvoid glVertex4s( GLshort x, GLshort y, GLshort z, GLshort w )
 {
-    init();
-    static void (*func)(GLshort, GLshort, GLshort, GLshort) = NULL;
-    if (!func)
-        func = (void (*)(GLshort, GLshort, GLshort, GLshort)) dlsym(RTLD_NEXT, "glVertex4s");
+    verbprintf(TRACE_CALLS, "glVertex4s(%d, %d, %d, %d);\n", x, y, z, w);
 
-    verbprintf("glVertex4s(%d, %d, %d, %d);\n", x, y, z, w);
-
-    func(x, y, z, w);
+    REAL(glVertex4s)(x, y, z, w);
 }
 #endif
 
 #ifdef DO_2D_VERTEX
 glvoid glVertex2dv( const GLdouble *v )
 {
-    init();
-    static void (*func)(const GLdouble *) = NULL;
-    if (!func)
-        func = (void (*)(const GLdouble *)) dlsym(RTLD_NEXT, "glVertex2dv");
+    verbprintf(TRACE_CALLS, "glVertex2dv(%f, %f);\n", v[0], v[1]);
 
-    verbprintf("glVertex2dv(%f, %f);\n", v[0], v[1]);
-
-    func(v);
+    REAL(glVertex2dv)(v);
 }
 
 glvoid glVertex2fv( const GLfloat *v )
 {
-    init();
-    static void (*func)(const GLfloat *) = NULL;
-    if (!func)
-        func = (void (*)(const GLfloat *)) dlsym(RTLD_NEXT, "glVertex2fv");
+    verbprintf(TRACE_CALLS, "glVertex2fv(%f, %f);\n", v[0], v[1]);
 
-    verbprintf("glVertex2fv(%f, %f);\n", v[0], v[1]);
-
-    func(v);
+    REAL(glVertex2fv)(v);
 }
 
 glvoid glVertex2iv( const GLint *v )
 {
-    init();
-    static void (*func)(const GLint *) = NULL;
-    if (!func)
-        func = (void (*)(const GLint *)) dlsym(RTLD_NEXT, "glVertex2iv");
+    verbprintf(TRACE_CALLS, "glVertex2iv(%d, %d);\n", v[0], v[1]);
 
-    verbprintf("glVertex2iv(%d, %d);\n", v[0], v[1]);
-
-    func(v);
+    REAL(glVertex2iv)(v);
 }
 
 glvoid glVertex2sv( const GLshort *v )
 {
-    init();
-    static void (*func)(const GLshort *) = NULL;
-    if (!func)
-        func = (void (*)(const GLshort *)) dlsym(RTLD_NEXT, "glVertex2sv");
+    verbprintf(TRACE_CALLS, "glVertex2sv(%d, %d);\n", v[0], v[1]);
 
-    verbprintf("glVertex2sv(%d, %d);\n", v[0], v[1]);
-
-    func(v);
+    REAL(glVertex2sv)(v);
 }
 #endif
 
 #ifdef DO_3D_VERTEX
 glvoid glVertex3dv( const GLdouble *v )
 {
-    init();
-    static void (*func)(const GLdouble *) = NULL;
-    if (!func)
-        func = (void (*)(const GLdouble *)) dlsym(RTLD_NEXT, "glVertex3dv");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glVertex3dv(%f, %f, %f);\n", v[0], v[1], v[2]);
+        verbprintf(TRACE_CALLS, "glVertex3dv(%f, %f, %f);\n", v[0], v[1], v[2]);
         new_V3(v[0], v[1], v[2]);
-        dump_count--;
     }
 
-    func(v);
+    REAL(glVertex3dv)(v);
 }
 
 glvoid glVertex3fv( const GLfloat *v )
 {
-    init();
-    static void (*func)(const GLfloat *) = NULL;
-    if (!func)
-        func = (void (*)(const GLfloat *)) dlsym(RTLD_NEXT, "glVertex3fv");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glVertex3fv(%f, %f, %f);\n", v[0], v[1], v[2]);
+        verbprintf(TRACE_CALLS, "glVertex3fv(%f, %f, %f);\n", v[0], v[1], v[2]);
         new_V3(v[0], v[1], v[2]);
-        dump_count--;
     }
 
-    func(v);
+    REAL(glVertex3fv)(v);
 }
 
 glvoid glVertex3iv( const GLint *v )
 {
-    init();
-    static void (*func)(const GLint *) = NULL;
-    if (!func)
-        func = (void (*)(const GLint *)) dlsym(RTLD_NEXT, "glVertex3iv");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glVertex3iv(%d, %d, %d);\n", v[0], v[1], v[2]);
+        verbprintf(TRACE_CALLS, "glVertex3iv(%d, %d, %d);\n", v[0], v[1], v[2]);
         new_V3(v[0], v[1], v[2]);
-        dump_count--;
     }
 
-    func(v);
+    REAL(glVertex3iv)(v);
 }
 
 glvoid glVertex3sv( const GLshort *v )
 {
-    init();
-    static void (*func)(const GLshort *) = NULL;
-    if (!func)
-        func = (void (*)(const GLshort *)) dlsym(RTLD_NEXT, "glVertex3sv");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glVertex3sv(%d, %d, %d);\n", v[0], v[1], v[2]);
+        verbprintf(TRACE_CALLS, "glVertex3sv(%d, %d, %d);\n", v[0], v[1], v[2]);
         new_V3(v[0], v[1], v[2]);
-        dump_count--;
     }
 
-    func(v);
+    REAL(glVertex3sv)(v);
 }
 #endif
 
 #ifdef DO_4D_VERTEX
 glvoid glVertex4dv( const GLdouble *v )
 {
-    init();
-    static void (*func)(const GLdouble *) = NULL;
-    if (!func)
-        func = (void (*)(const GLdouble *)) dlsym(RTLD_NEXT, "glVertex4dv");
+    verbprintf(TRACE_CALLS, "glVertex4dv(%f, %f, %f, %f);\n", v[0], v[1], v[2], v[3]);
 
-    verbprintf("glVertex4dv(%f, %f, %f, %f);\n", v[0], v[1], v[2], v[4]);
-
-    func(v);
+    REAL(glVertex4dv)(v);
 }
 
 glvoid glVertex4fv( const GLfloat *v )
 {
-    init();
-    static void (*func)(const GLfloat *) = NULL;
-    if (!func)
-        func = (void (*)(const GLfloat *)) dlsym(RTLD_NEXT, "glVertex4fv");
+    verbprintf(TRACE_CALLS, "glVertex4fv(%f, %f, %f, %f);\n", v[0], v[1], v[2], v[3]);
 
-    verbprintf("glVertex4fv(%f, %f, %f, %f);\n", v[0], v[1], v[2], v[4]);
-
-    func(v);
+    REAL(glVertex4fv)(v);
 }
 
 glvoid glVertex4iv( const GLint *v )
 {
-    init();
-    static void (*func)(const GLint *) = NULL;
-    if (!func)
-        func = (void (*)(const GLint *)) dlsym(RTLD_NEXT, "glVertex4iv");
+    verbprintf(TRACE_CALLS, "glVertex4iv(%d, %d, %d, %d);\n", v[0], v[1], v[2], v[3]);
 
-    verbprintf("glVertex4iv(%d, %d, %d, %d);\n", v[0], v[1], v[2], v[4]);
-
-    func(v);
+    REAL(glVertex4iv)(v);
 }
 
 glvoid glVertex4sv( const GLshort *v )
 {
-    init();
-    static void (*func)(const GLshort *) = NULL;
-    if (!func)
-        func = (void (*)(const GLshort *)) dlsym(RTLD_NEXT, "glVertex4sv");
+    verbprintf(TRACE_CALLS, "glVertex4sv(%d, %d, %d, %d);\n", v[0], v[1], v[2], v[3]);
 
-    verbprintf("glVertex4sv(%d, %d, %d, %d);\n", v[0], v[1], v[2], v[4]);
-
-    func(v);
+    REAL(glVertex4sv)(v);
 }
 #endif
 
 #ifdef DO_3D_NORMAL
 glvoid glNormal3b( GLbyte x, GLbyte y, GLbyte z )
 {
-    init();
-    static void (*func)(GLbyte, GLbyte, GLbyte) = NULL;
-    if (!func)
-        func = (void (*)(GLbyte, GLbyte, GLbyte)) dlsym(RTLD_NEXT, "glNormal3b");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3b(%d, %d, %d);\n", x, y, z);
+        verbprintf(TRACE_CALLS, "glNormal3b(%d, %d, %d);\n", x, y, z);
         new_N3(x, y, z);
-        dump_count--;
     }
 
-    func(x, y, z);
+    REAL(glNormal3b)(x, y, z);
 }
 
 glvoid glNormal3d( GLdouble x, GLdouble y, GLdouble z )
 {
-    init();
-    static void (*func)(GLdouble, GLdouble, GLdouble) = NULL;
-    if (!func)
-        func = (void (*)(GLdouble, GLdouble, GLdouble)) dlsym(RTLD_NEXT, "glNormal3d");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3d(%f, %f, %f);\n", x, y, z);
+        verbprintf(TRACE_CALLS, "glNormal3d(%f, %f, %f);\n", x, y, z);
         new_N3(x, y, z);
-        dump_count--;
     }
 
-    func(x, y, z);
+    REAL(glNormal3d)(x, y, z);
 }
 
 glvoid glNormal3f( GLfloat x, GLfloat y, GLfloat z )
 {
-    init();
-    static void (*func)(GLfloat, GLfloat, GLfloat) = NULL;
-    if (!func)
-        func = (void (*)(GLfloat, GLfloat, GLfloat)) dlsym(RTLD_NEXT, "glNormal3f");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3f(%f, %f, %f);\n", x, y, z);
+        verbprintf(TRACE_CALLS, "glNormal3f(%f, %f, %f);\n", x, y, z);
         new_N3(x, y, z);
-        dump_count--;
     }
 
-    func(x, y, z);
+    REAL(glNormal3f)(x, y, z);
 }
 
 glvoid glNormal3i( GLint x, GLint y, GLint z )
 {
-    init();
-    static void (*func)(GLint, GLint, GLint) = NULL;
-    if (!func)
-        func = (void (*)(GLint, GLint, GLint)) dlsym(RTLD_NEXT, "glNormal3i");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3i(%d, %d, %d);\n", x, y, z);
+        verbprintf(TRACE_CALLS, "glNormal3i(%d, %d, %d);\n", x, y, z);
         new_N3(x, y, z);
-        dump_count--;
     }
 
-    func(x, y, z);
+    REAL(glNormal3i)(x, y, z);
 }
 
 glvoid glNormal3s( GLshort x, GLshort y, GLshort z )
 {
-    init();
-    static void (*func)(GLshort, GLshort, GLshort) = NULL;
-    if (!func)
-        func = (void (*)(GLshort, GLshort, GLshort)) dlsym(RTLD_NEXT, "glNormal3s");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3s(%d, %d, %d);\n", x, y, z);
+        verbprintf(TRACE_CALLS, "glNormal3s(%d, %d, %d);\n", x, y, z);
         new_N3(x, y, z);
-        dump_count--;
     }
 
-    func(x, y, z);
+    REAL(glNormal3s)(x, y, z);
 }
 
 glvoid glNormal3bv( const GLbyte *v )
 {
-    init();
-    static void (*func)(const GLbyte *) = NULL;
-    if (!func)
-        func = (void (*)(const GLbyte *)) dlsym(RTLD_NEXT, "glNormal3bv");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3bv(%d, %d, %d);\n", v[0], v[1], v[2]);
+        verbprintf(TRACE_CALLS, "glNormal3bv(%d, %d, %d);\n", v[0], v[1], v[2]);
         new_N3(v[0], v[1], v[2]);
-        dump_count--;
     }
 
-    func(v);
+    REAL(glNormal3bv)(v);
 }
 
 glvoid glNormal3dv( const GLdouble *v )
 {
-    init();
-    static void (*func)(const GLdouble *) = NULL;
-    if (!func)
-        func = (void (*)(const GLdouble *)) dlsym(RTLD_NEXT, "glNormal3dv");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3dv(%f, %f, %f);\n", v[0], v[1], v[2]);
+        verbprintf(TRACE_CALLS, "glNormal3dv(%f, %f, %f);\n", v[0], v[1], v[2]);
         new_N3(v[0], v[1], v[2]);
-        dump_count--;
     }
 
-    func(v);
+    REAL(glNormal3dv)(v);
 }
 
 glvoid glNormal3fv( const GLfloat *v )
 {
-    init();
-    static void (*func)(const GLfloat *) = NULL;
-    if (!func)
-        func = (void (*)(const GLfloat *)) dlsym(RTLD_NEXT, "glNormal3fv");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3fv(%f, %f, %f);\n", v[0], v[1], v[2]);
+        verbprintf(TRACE_CALLS, "glNormal3fv(%f, %f, %f);\n", v[0], v[1], v[2]);
         new_N3(v[0], v[1], v[2]);
-        dump_count--;
     }
 
-    func(v);
+    REAL(glNormal3fv)(v);
 }
 
 glvoid glNormal3iv( const GLint *v )
 {
-    init();
-    static void (*func)(const GLint *) = NULL;
-    if (!func)
-        func = (void (*)(const GLint *)) dlsym(RTLD_NEXT, "glNormal3iv");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3iv(%d, %d, %d);\n", v[0], v[1], v[2]);
+        verbprintf(TRACE_CALLS, "glNormal3iv(%d, %d, %d);\n", v[0], v[1], v[2]);
         new_N3(v[0], v[1], v[2]);
-        dump_count--;
     }
 
-    func(v);
+    REAL(glNormal3iv)(v);
 }
 
 glvoid glNormal3sv( const GLshort *v )
 {
-    init();
-    static void (*func)(const GLshort *) = NULL;
-    if (!func)
-        func = (void (*)(const GLshort *)) dlsym(RTLD_NEXT, "glNormal3sv");
-
-    if (dump_count)
+    if (dump_on())
     {
-        verbprintf("glNormal3sv(%d, %d, %d);\n", v[0], v[1], v[2]);
+        verbprintf(TRACE_CALLS, "glNormal3sv(%d, %d, %d);\n", v[0], v[1], v[2]);
         new_N3(v[0], v[1], v[2]);
-        dump_count--;
     }
 
-    func(v);
+    REAL(glNormal3sv)(v);
 }
 #endif
 
 
 #ifdef DO_DRAW_ELEMENTS
+/* client array state is tracked all the time, so draws have it */
+/* once recording starts. it doesn't count against the budget.   */
 void glVertexPointer( GLint size, GLenum type,
         GLsizei stride, const GLvoid *ptr )
 {
-    init();
-    static void (*func)(GLint, GLenum, GLsizei, const GLvoid *) = NULL;
-    if (!func)
-        func = (void (*)(GLint, GLenum, GLsizei, const GLvoid *)) dlsym(RTLD_NEXT, "glVertexPointer");
+    verbprintf(TRACE_PRIMS, "glVertexPointer(%d, 0x%x, %d, %p);\n",
+            size, type, stride, ptr);
+    new_VertexPointer(size, type, stride, ptr);
 
-    if (dump_count)
-    {
-        verbprintf("glVertexPointer(%d, %d, %d, 0x%8.8x);\n",
-                size, type, stride, (unsigned int) ptr);
-        new_VertexPointer( size, type, stride, ptr);
-        dump_count--;
-    }
+    REAL(glVertexPointer)(size, type, stride, ptr);
+}
+
+void glNormalPointer( GLenum type, GLsizei stride, const GLvoid *ptr )
+{
+    verbprintf(TRACE_PRIMS, "glNormalPointer(0x%x, %d, %p);\n",
+            type, stride, ptr);
+    new_NormalPointer(type, stride, ptr);
+
+    REAL(glNormalPointer)(type, stride, ptr);
+}
+
+void glTexCoordPointer( GLint size, GLenum type,
+        GLsizei stride, const GLvoid *ptr )
+{
+    verbprintf(TRACE_PRIMS, "glTexCoordPointer(%d, 0x%x, %d, %p);\n",
+            size, type, stride, ptr);
+    new_TexCoordPointer(size, type, stride, ptr);
+
+    REAL(glTexCoordPointer)(size, type, stride, ptr);
+}
+
+void glColorPointer( GLint size, GLenum type,
+        GLsizei stride, const GLvoid *ptr )
+{
+    verbprintf(TRACE_PRIMS, "glColorPointer(%d, 0x%x, %d, %p);\n",
+            size, type, stride, ptr);
+    new_ColorPointer(size, type, stride, ptr);
+
+    REAL(glColorPointer)(size, type, stride, ptr);
+}
+
+void glInterleavedArrays( GLenum format, GLsizei stride,
+        const GLvoid *pointer )
+{
+    verbprintf(TRACE_PRIMS, "glInterleavedArrays(0x%x, %d, %p);\n",
+            format, stride, pointer);
+    new_InterleavedArrays(format, stride, pointer);
+
+    REAL(glInterleavedArrays)(format, stride, pointer);
+}
+
+void glEnableClientState( GLenum array )
+{
+    verbprintf(TRACE_PRIMS, "glEnableClientState(0x%x);\n", array);
+    set_client_state(array, 1);
+
+    REAL(glEnableClientState)(array);
+}
+
+void glDisableClientState( GLenum array )
+{
+    verbprintf(TRACE_PRIMS, "glDisableClientState(0x%x);\n", array);
+    set_client_state(array, 0);
 
-    func(size, type, stride, ptr);
+    REAL(glDisableClientState)(array);
 }
 
 void glDrawElements( GLenum mode, GLsizei count,
         GLenum type, const GLvoid *indices )
 {
-    init();
-    static void (*func)(GLenum, GLsizei, GLenum, const GLvoid *) = NULL;
-    if (!func)
-        func = (void (*)(GLenum, GLsizei, GLenum, const GLvoid *)) dlsym(RTLD_NEXT, "glDrawElements");
+    if (dump_on())
+    {
+        verbprintf(TRACE_PRIMS, "glDrawElements(%s, %d, 0x%x, %p); /* [%d] */\n",
+                prim_name(mode), count, type, indices, nDrawElements);
+
+        new_DrawElements(mode, count, type, indices);
+        capture_check(recorder());
+    }
 
-    if (dump_count)
+    REAL(glDrawElements)(mode, count, type, indices);
+}
+
+void glDrawArrays( GLenum mode, GLint first, GLsizei count )
+{
+    if (dump_on())
+    {
+        verbprintf(TRACE_PRIMS, "glDrawArrays(%s, %d, %d); /* [%d] */\n",
+                prim_name(mode), first, count, nDrawElements);
+
+        new_DrawArrays(mode, first, count);
+        capture_check(recorder());
+    }
+
+    REAL(glDrawArrays)(mode, first, count);
+}
+
+/* start and end are only a hint, the range is scanned anyway */
+void glDrawRangeElements( GLenum mode, GLuint start, GLuint end,
+        GLsizei count, GLenum type, const GLvoid *indices )
+{
+    if (dump_on())
     {
-        verbprintf("glDrawElements(%s, %d, 0x%x, 0x%8.8x); /* [%d] */\n",
-                prim_type_name[mode], count, type, (unsigned int) indices, nDrawElements);
+        verbprintf(TRACE_PRIMS, "glDrawRangeElements(%s, %d, %d, %d, 0x%x, %p); /* [%d] */\n",
+                prim_name(mode), start, end, count, type, indices,
+                nDrawElements);
 
         new_DrawElements(mode, count, type, indices);
-        dump_count--;
+        capture_check(recorder());
     }
 
-    func(mode, count, type, indices);
+    REAL(glDrawRangeElements)(mode, start, end, count, type, indices);
 }
-#endif
 
-#if 1
-/* omit Vertec Buffer Objects by returning an incompatible version  */
-/* FIXME it's a dirty hack, supporting VBOs would be the real thing */
-const GLubyte * glGetString( GLenum name )
+/* every sub-draw is recorded (and exported) on its own */
+void glMultiDrawArrays( GLenum mode, const GLint *first,
+        const GLsizei *count, GLsizei drawcount )
 {
-    init();
-    static const GLubyte * (*func)(GLenum) = NULL;
-    if (!func)
-        func = (const GLubyte * (*)(GLenum)) dlsym(RTLD_NEXT, "glGetString");
+    if (dump_on())
+    {
+        verbprintf(TRACE_PRIMS, "glMultiDrawArrays(%s, %p, %p, %d); /* [%d] */\n",
+                prim_name(mode), first, count, drawcount, nDrawElements);
 
-    verbprintf("glGetString( %d );\n", name);
+        int i;
+        for (i=0; i<drawcount; i++)
+            new_DrawArrays(mode, first[i], count[i]);
+        capture_check(recorder());
+    }
 
-    switch (name){
-        case GL_EXTENSIONS:
-            verbprintf("\tGL_EXTENSIONS:we return \"\" instead of %s\n",
-                    func(name));
-            return (const GLubyte *) "";
-            break;
-        case GL_VENDOR:
-            verbprintf("\tGL_VENDOR:we return \"\" instead of %s\n",
-                    func(name));
-            return (const GLubyte *) "";
-            break;
-        case GL_RENDERER:
-            verbprintf("\tGL_RENDERER:we return \"\" instead of %s\n",
-                    func(name));
-            return (const GLubyte *) "";
-            break;
-        case GL_VERSION:
-            verbprintf("\tGL_VERSION: we return \"\" instead of %s\n",
-                    func(name));
-            return (const GLubyte *) "1.2";
-            break;
-        default:
-            return func(name);
+    REAL(glMultiDrawArrays)(mode, first, count, drawcount);
+}
+
+void glMultiDrawElements( GLenum mode, const GLsizei *count, GLenum type,
+        const GLvoid * const *indices, GLsizei drawcount )
+{
+    if (dump_on())
+    {
+        verbprintf(TRACE_PRIMS, "glMultiDrawElements(%s, %p, 0x%x, %p, %d); /* [%d] */\n",
+                prim_name(mode), count, type, indices, drawcount,
+                nDrawElements);
+
+        int i;
+        for (i=0; i<drawcount; i++)
+            new_DrawElements(mode, count[i], type, indices[i]);
+        capture_check(recorder());
+    }
+
+    REAL(glMultiDrawElements)(mode, count, type, indices, drawcount);
+}
+#endif
+
+/* a frame is done, hand it to the exporter thread. */
+/* captures are started and stopped here.           */
+glvoid glXSwapBuffers( Display * dpy, GLXDrawable drawable )
+{
+    if (ring_frames) {
+        frame_end();
+        ring_frame_end(recorder());
+    } else {
+        if (dump_on() && async_mode)
+            capture_flush(recorder());
+        frame_end();
     }
+
+    REAL(glXSwapBuffers)(dpy, drawable);
+}
+
+/* GL state is kept per context */
+Bool glXMakeCurrent( Display * dpy, GLXDrawable drawable, GLXContext ctx )
+{
+    Bool ret = REAL(glXMakeCurrent)(dpy, drawable, ctx);
+    if (ret)
+        context_make_current(ctx);
+    return ret;
+}
+
+Bool glXMakeContextCurrent( Display * dpy, GLXDrawable draw,
+        GLXDrawable read, GLXContext ctx )
+{
+    Bool ret = REAL(glXMakeContextCurrent)(dpy, draw, read, ctx);
+    if (ret)
+        context_make_current(ctx);
+    return ret;
+}
+
+#ifdef DO_BUFFER_OBJECTS
+glvoid glGenBuffers( GLsizei n, GLuint * buffers )
+{
+    REAL(glGenBuffers)(n, buffers);
+    buffer_gen(n, buffers);
+}
+
+glvoid glGenBuffersARB( GLsizei n, GLuint * buffers )
+{
+    REAL(glGenBuffersARB)(n, buffers);
+    buffer_gen(n, buffers);
+}
+
+glvoid glDeleteBuffers( GLsizei n, const GLuint * buffers )
+{
+    buffer_delete(n, buffers);
+    REAL(glDeleteBuffers)(n, buffers);
+}
+
+glvoid glDeleteBuffersARB( GLsizei n, const GLuint * buffers )
+{
+    buffer_delete(n, buffers);
+    REAL(glDeleteBuffersARB)(n, buffers);
+}
+
+glvoid glBindBuffer( GLenum target, GLuint buffer )
+{
+    verbprintf(TRACE_PRIMS, "glBindBuffer(0x%x, %d);\n", target, buffer);
+    buffer_bind(target, buffer);
+    REAL(glBindBuffer)(target, buffer);
+}
+
+glvoid glBindBufferARB( GLenum target, GLuint buffer )
+{
+    verbprintf(TRACE_PRIMS, "glBindBufferARB(0x%x, %d);\n", target, buffer);
+    buffer_bind(target, buffer);
+    REAL(glBindBufferARB)(target, buffer);
+}
+
+glvoid glBufferData( GLenum target, GLsizeiptr size,
+        const GLvoid * data, GLenum usage )
+{
+    verbprintf(TRACE_PRIMS, "glBufferData(0x%x, %ld, %p, 0x%x);\n",
+            target, (long) size, data, usage);
+    buffer_data(target, size, data);
+    REAL(glBufferData)(target, size, data, usage);
+}
+
+glvoid glBufferDataARB( GLenum target, GLsizeiptrARB size,
+        const GLvoid * data, GLenum usage )
+{
+    verbprintf(TRACE_PRIMS, "glBufferDataARB(0x%x, %ld, %p, 0x%x);\n",
+            target, (long) size, data, usage);
+    buffer_data(target, size, data);
+    REAL(glBufferDataARB)(target, size, data, usage);
+}
+
+glvoid glBufferSubData( GLenum target, GLintptr offset,
+        GLsizeiptr size, const GLvoid * data )
+{
+    buffer_subdata(target, offset, size, data);
+    REAL(glBufferSubData)(target, offset, size, data);
+}
+
+glvoid glBufferSubDataARB( GLenum target, GLintptrARB offset,
+        GLsizeiptrARB size, const GLvoid * data )
+{
+    buffer_subdata(target, offset, size, data);
+    REAL(glBufferSubDataARB)(target, offset, size, data);
+}
+
+void * glMapBuffer( GLenum target, GLenum access )
+{
+    void * ptr = REAL(glMapBuffer)(target, access);
+    struct buffer_t ** binding = buffer_binding(target);
+    if (binding && *binding)
+        buffer_map(target, ptr, 0, (*binding)->size, access != GL_READ_ONLY);
+    return ptr;
+}
+
+void * glMapBufferARB( GLenum target, GLenum access )
+{
+    void * ptr = REAL(glMapBufferARB)(target, access);
+    struct buffer_t ** binding = buffer_binding(target);
+    if (binding && *binding)
+        buffer_map(target, ptr, 0, (*binding)->size, access != GL_READ_ONLY);
+    return ptr;
+}
+
+void * glMapBufferRange( GLenum target, GLintptr offset,
+        GLsizeiptr length, GLbitfield access )
+{
+    void * ptr = REAL(glMapBufferRange)(target, offset, length, access);
+    buffer_map(target, ptr, offset, length, access & GL_MAP_WRITE_BIT);
+    return ptr;
+}
+
+GLboolean glUnmapBuffer( GLenum target )
+{
+    buffer_unmap(target);
+    return REAL(glUnmapBuffer)(target);
+}
+
+GLboolean glUnmapBufferARB( GLenum target )
+{
+    buffer_unmap(target);
+    return REAL(glUnmapBufferARB)(target);
+}
+#endif
+
+#ifdef DO_MATRIX_STACK
+/* matrix state is tracked all the time, like client array state */
+glvoid glMatrixMode( GLenum mode )
+{
+    matrix_mode(mode);
+    REAL(glMatrixMode)(mode);
+}
+
+glvoid glLoadIdentity( void )
+{
+    matrix_identity();
+    REAL(glLoadIdentity)();
+}
+
+glvoid glLoadMatrixf( const GLfloat *m )
+{
+    matrix_load(m);
+    REAL(glLoadMatrixf)(m);
+}
+
+glvoid glLoadMatrixd( const GLdouble *m )
+{
+    float f[16];
+    int i;
+    for (i=0; i<16; i++)
+        f[i] = m[i];
+    matrix_load(f);
+    REAL(glLoadMatrixd)(m);
+}
+
+glvoid glMultMatrixf( const GLfloat *m )
+{
+    matrix_mult(m);
+    REAL(glMultMatrixf)(m);
+}
+
+glvoid glMultMatrixd( const GLdouble *m )
+{
+    float f[16];
+    int i;
+    for (i=0; i<16; i++)
+        f[i] = m[i];
+    matrix_mult(f);
+    REAL(glMultMatrixd)(m);
+}
+
+glvoid glTranslatef( GLfloat x, GLfloat y, GLfloat z )
+{
+    matrix_translate(x, y, z);
+    REAL(glTranslatef)(x, y, z);
+}
+
+glvoid glTranslated( GLdouble x, GLdouble y, GLdouble z )
+{
+    matrix_translate(x, y, z);
+    REAL(glTranslated)(x, y, z);
+}
+
+glvoid glRotatef( GLfloat angle, GLfloat x, GLfloat y, GLfloat z )
+{
+    matrix_rotate(angle, x, y, z);
+    REAL(glRotatef)(angle, x, y, z);
+}
+
+glvoid glRotated( GLdouble angle, GLdouble x, GLdouble y, GLdouble z )
+{
+    matrix_rotate(angle, x, y, z);
+    REAL(glRotated)(angle, x, y, z);
+}
+
+glvoid glScalef( GLfloat x, GLfloat y, GLfloat z )
+{
+    matrix_scale(x, y, z);
+    REAL(glScalef)(x, y, z);
+}
+
+glvoid glScaled( GLdouble x, GLdouble y, GLdouble z )
+{
+    matrix_scale(x, y, z);
+    REAL(glScaled)(x, y, z);
+}
+
+glvoid glPushMatrix( void )
+{
+    matrix_push();
+    REAL(glPushMatrix)();
+}
+
+glvoid glPopMatrix( void )
+{
+    matrix_pop();
+    REAL(glPopMatrix)();
 }
 #endif
 
+/* entry points fetched at run time are the wrappers, too, so apps */
+/* that never link them directly are recorded just the same. calls */
+/* through them cost what direct calls cost.                       */
+struct gl_proc_t {
+    const char      * name;
+    __GLXextFuncPtr   wrapper;
+    void           ** real; /* the wrapper is only handed out if set */
+};
+
+const struct gl_proc_t gl_procs[] = {
+#define X(ret, name, args) { #name, (__GLXextFuncPtr) name, (void **) &real.name },
+    GL_FUNCS(X)
+#undef X
+    /* extension names of wrapped core functions */
+    { "glDrawRangeElementsEXT", (__GLXextFuncPtr) glDrawRangeElements,
+        (void **) &real.glDrawRangeElements },
+    { "glMultiDrawArraysEXT", (__GLXextFuncPtr) glMultiDrawArrays,
+        (void **) &real.glMultiDrawArrays },
+    { "glMultiDrawElementsEXT", (__GLXextFuncPtr) glMultiDrawElements,
+        (void **) &real.glMultiDrawElements },
+};
+
+/* NULL for names that aren't wrapped */
+__GLXextFuncPtr gl_proc_lookup(const GLubyte * name)
+{
+    size_t i;
+
+    for (i=0; i<sizeof(gl_procs) / sizeof(gl_procs[0]); i++) {
+        if (strcmp((const char *) name, gl_procs[i].name))
+            continue;
+        if (!__atomic_load_n(gl_procs[i].real, __ATOMIC_RELAXED) &&
+                !dispatch_find(gl_procs[i].name, gl_procs[i].real))
+            return NULL;
+        return gl_procs[i].wrapper;
+    }
+    return NULL;
+}
+
+__GLXextFuncPtr glXGetProcAddress( const GLubyte * name )
+{
+    __GLXextFuncPtr p = gl_proc_lookup(name);
+    if (p)
+        return p;
+    if (REAL_FIND(glXGetProcAddress))
+        return REAL(glXGetProcAddress)(name);
+    return REAL_FIND(glXGetProcAddressARB) ? REAL(glXGetProcAddressARB)(name) : NULL;
+}
+
+__GLXextFuncPtr glXGetProcAddressARB( const GLubyte * name )
+{
+    __GLXextFuncPtr p = gl_proc_lookup(name);
+    if (p)
+        return p;
+    if (REAL_FIND(glXGetProcAddressARB))
+        return REAL(glXGetProcAddressARB)(name);
+    return REAL_FIND(glXGetProcAddress) ? REAL(glXGetProcAddress)(name) : NULL;
+}
+
+#endif /* OGLDUMP_CONVERT */
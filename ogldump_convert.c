@@ -0,0 +1,78 @@
+/*
+ * ogldump_convert.c - turn a raw ogldump capture stream into STL, OBJ
+ *                     or PLY files
+ *
+ * the captures are replayed through the exporter of ogldump.c, which
+ * is built into this program without its GL wrappers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ogr.h"
+
+void usage(void)
+{
+    printf("\nogldump_convert - convert a raw capture stream (OGLDUMP_FORMAT=raw)\n\n");
+    printf("usage: ogldump_convert [options] capture.ogr\n");
+    printf("options:\n");
+    printf("\t-d dir     : write to dir, defaults to the current one\n");
+    printf("\t-f format  : stl (the default), obj, ply, frame and\n");
+    printf("\t             capture for .ogd containers, or gltf for\n");
+    printf("\t             scene.gltf and scene.bin\n");
+    printf("\t-j threads : number of writer threads, defaults to all cpus\n");
+    printf("\t-a         : write all objects, also repeated meshes\n");
+    printf("\t-h         : show this help\n");
+}
+
+int main(int argc, char ** argv)
+{
+    const char * dir    = ".";
+    const char * format = "stl";
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int optchar;
+    char * endptr;
+
+    while ((optchar = getopt(argc, argv, "d:f:j:ah")) != -1)
+    {
+        switch (optchar) {
+            case 'd':
+                dir = optarg;
+                break;
+            case 'f':
+                format = optarg;
+                break;
+            case 'j':
+                threads = strtol(optarg, &endptr, 0);
+                if (endptr == optarg || threads < 1) {
+                    usage();
+                    exit(1);
+                }
+                break;
+            case 'a':
+                dedup_mode = 0;
+                break;
+            case 'h':
+                usage();
+                exit(0);
+            default:
+                usage();
+                exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        exit(1);
+    }
+    if (threads > 16)
+        threads = 16;
+
+    return ogr_replay(argv[optind], dir, format, threads) ? 1 : 0;
+}
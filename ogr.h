@@ -0,0 +1,122 @@
+/*
+ * ogr.h - ogldump raw capture streams
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#ifndef OGR_H
+#define OGR_H
+
+#include <stdint.h>
+
+/* with OGLDUMP_FORMAT=raw the captures are written as recorded, */
+/* nothing is converted in the traced process. the stream is     */
+/*   struct ogr_header_t                                         */
+/*   chunks, each struct ogr_chunk_t and its (compressed) records */
+/* a record is a struct ogr_rec_t and len bytes of payload.       */
+/* records never span chunks. every export of a capture is a     */
+/* segment of its own, the chunks of segments written by         */
+/* different threads interleave. blob and list ids are per       */
+/* segment and count up from 0 in the order they're defined, a   */
+/* display list is defined once in every segment that calls it.  */
+/* ogldump_convert turns a stream into STL, OBJ or PLY files.     */
+
+#define OGR_MAGIC     "OGLDRAW" /* 8 bytes with the 0 */
+#define OGR_VERSION   2
+#define OGR_FNAME     "capture.ogr"
+#define OGR_NO_BLOB   0xffffffff
+
+struct ogr_header_t {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+enum { OGR_STORED, OGR_ZLIB };
+
+struct ogr_chunk_t {
+    uint32_t segment;
+    uint32_t codec;   /* OGR_STORED or OGR_ZLIB */
+    uint32_t raw_len; /* of the records */
+    uint32_t len;     /* what follows in the file */
+};
+
+enum {
+    OGR_BLOB = 1, /* uint32_t id, then the bytes */
+    OGR_PRIM,     /* struct ogr_prim_t */
+    OGR_DRAW,     /* struct ogr_draw_t */
+    OGR_END,      /* the segment is complete */
+    OGR_LIST,     /* uint32_t id, the list's records up to OGR_LIST_END */
+    OGR_LIST_END,
+    OGR_CALL,     /* struct ogr_call_t */
+};
+
+struct ogr_rec_t {
+    uint32_t type;
+    uint32_t len;
+};
+
+/* the modelview field of the records below. in a list an  */
+/* absolute modelview was loaded there, it isn't relative   */
+/* to the call's                                            */
+#define OGR_MODELVIEW          1 /* 16 floats follow */
+#define OGR_MODELVIEW_ABSOLUTE 2
+
+/* followed by the modelview (16 floats) if there is one, */
+/* then nV3 x,y,z vertices and nV3 x,y,z normals           */
+struct ogr_prim_t {
+    int32_t  n;
+    uint32_t frame;
+    uint32_t capture;
+    uint32_t type;
+    uint32_t nV3;
+    uint32_t modelview;
+};
+
+/* an array of a draw, the vertices min_index to max_index */
+struct ogr_array_t {
+    int32_t  size;  /* 0 if the array wasn't enabled */
+    uint32_t type;
+    int32_t  stride;
+    int32_t  sizeof_type;
+    uint32_t min_index;
+    uint32_t max_index;
+    uint32_t blob;
+};
+
+/* followed by the modelview if there is one */
+struct ogr_draw_t {
+    int32_t            n;
+    uint32_t           frame;
+    uint32_t           capture;
+    uint32_t           mode;
+    int32_t            count;
+    uint32_t           type;     /* of the indices, 0 for glDrawArrays() */
+    int32_t            sizeof_type;
+    uint32_t           indices;  /* blob, OGR_NO_BLOB for glDrawArrays() */
+    uint32_t           modelview;
+    struct ogr_array_t arrays[4]; /* vertex, normal, texcoord, color */
+};
+
+/* a glCallList() of a list defined before, */
+/* followed by the modelview if there is one */
+struct ogr_call_t {
+    int32_t  n;
+    uint32_t frame;
+    uint32_t capture;
+    uint32_t list;
+    uint32_t modelview;
+};
+
+/* converts the stream in fname to files of format ("stl", "obj", */
+/* ...) in dir, with threads writers. in ogldump.c, 0 on success   */
+int ogr_replay(const char * fname, const char * dir, const char * format,
+        int threads);
+
+/* 0 writes meshes that occurred before again, see OGLDUMP_DEDUP */
+extern int dedup_mode;
+
+#endif
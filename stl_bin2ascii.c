@@ -10,12 +10,15 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
+#include "ogd.h"
+
 char  * fname;
 FILE  * f;
 float * t;     /* triangles */
@@ -23,30 +26,29 @@ int     n_tri; /* number of triangles */
 
 void usage(void)
 {
-    printf("usage: anders\n");
+    printf("usage: stl_bin2ascii file.stl\n");
+    printf("       stl_bin2ascii file.ogd       all objects of a container\n");
+    printf("       stl_bin2ascii file.ogd:name  one object of a container\n");
     exit(1);
 }
 
-int main(int argc, char ** argv)
+/* one object as one solid, named after the file or the object */
+void bin2ascii(struct ogd_object_t * o)
 {
     int ret, i;
-    f = fopen(argv[1], "r");
-    if (!f) {
-        printf("!!! couldn't fopen(%s) : %s\n",
-                argv[1], strerror(errno));
-        exit(1);
-    }
-    ret = fseek(f, 80, SEEK_SET);
+    char * name = o->name[0] ? o->name : fname;
+
+    ret = fseeko(f, o->offset + 80, SEEK_SET);
     if (ret) {
-        printf("!!! couldn't fseek(%s) to 80 : %s\n",
-                argv[1], strerror(errno));
+        printf("!!! couldn't fseek(%s) to %llu : %s\n",
+                fname, (unsigned long long) o->offset + 80, strerror(errno));
         fclose(f);
         exit(1);
     }
     ret = fread(&n_tri, 4, 1, f);
     if (ret!=1) {
         printf("!!! couldn't fread(%s): %s\n",
-                argv[1], strerror(errno));
+                fname, strerror(errno));
         fclose(f);
         exit(1);
     }
@@ -54,12 +56,12 @@ int main(int argc, char ** argv)
     ret = fread(t, 50, n_tri, f);
     if (ret!=n_tri) {
         printf("!!! couldn't fread(%s) triangles: %s\n",
-                argv[1], strerror(errno));
+                fname, strerror(errno));
         fclose(f);
         exit(1);
     }
 
-    printf("solid %s\n", argv[1]);
+    printf("solid %s\n", name);
     float * p;
     for (p=t, i=0; i<n_tri; i++) {
         printf("facet normal %E %E %E\n", p[0], p[1], p[2]);
@@ -71,8 +73,30 @@ int main(int argc, char ** argv)
         printf("endfacet\n");
         p = (float *)((char *)p+50);
     }
-    printf("endsolid %s\n", argv[1]);
+    printf("endsolid %s\n", name);
+    free(t);
+}
+
+int main(int argc, char ** argv)
+{
+    struct ogd_object_t * objs;
+    int n, i;
+
+    if (argc != 2)
+        usage();
+    n = ogd_objects(argv[1], &fname, &objs);
+    if (n < 0)
+        exit(1);
+    f = fopen(fname, "r");
+    if (!f) {
+        printf("!!! couldn't fopen(%s) : %s\n",
+                fname, strerror(errno));
+        exit(1);
+    }
+    for (i=0; i<n; i++)
+        bin2ascii(&objs[i]);
 
     fclose(f);
+    free(objs);
     return 0;
 }
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "ogd.h"
 
 #define BB_SZ 4.0 /* bounding box max scale */
 
@@ -40,7 +41,7 @@ int opt_z_off = 0;
 int file_count = 0;
 
 
-void read_file(char * fname)
+void read_file(char * fname, struct ogd_object_t * o)
 {
     int ret;
     f = fopen(fname, "r+");
@@ -50,9 +51,10 @@ void read_file(char * fname)
                 strerror(errno));
         exit(1);
     }
-    ret = fseek(f, 80, SEEK_SET);
+    ret = fseeko(f, o->offset + 80, SEEK_SET);
     if (ret) {
-        printf("!!! couldn't wind 80 bytes into %s: %s\n",
+        printf("!!! couldn't wind %llu bytes into %s: %s\n",
+                (unsigned long long) o->offset + 80,
                 fname,
                 strerror(errno));
         exit(1);
@@ -63,7 +65,8 @@ void read_file(char * fname)
                 strerror(errno));
         exit(1);
     }
-    printf("+++ %s has %d triangles\n", fname, n_file);
+    printf("+++ %s%s%s has %d triangles\n", fname,
+            o->name[0] ? ":" : "", o->name, n_file);
     t_file = malloc(n_file * 50);
     if (!t_file) {
         printf("!!! couldn't malloc %d bytes: %s\n",
@@ -192,13 +195,14 @@ void scale_file(void)
     }
 }
 
-void write_file(char * fname)
+/* in place, a container object keeps its size */
+void write_file(char * fname, struct ogd_object_t * o)
 {
     int ret;
 
-    printf("+++ writing STL file %s with %d triangles\n",
-            fname, n_file);
-    fseek(f, 0, SEEK_SET);
+    printf("+++ writing STL file %s%s%s with %d triangles\n",
+            fname, o->name[0] ? ":" : "", o->name, n_file);
+    fseeko(f, o->offset, SEEK_SET);
     if (80 != fwrite(stl_header, 1, 80, f)) {
         printf("!!! couldn't fwrite(%s) 1: %s\n",
                 fname, strerror(errno));
@@ -231,20 +235,31 @@ void usage(void)
 {
     printf("\nstl_norm - normalize .stl files\ni\n");
     printf("usage: stl_norm inputfile(s)\n");
+    printf("       all objects of an ogldump container (.ogd) are\n");
+    printf("       normalized, of file.ogd:name just the one\n");
 
 }
 
 void stl_norm(int argc, char ** argv)
 {
-    int i;
+    struct ogd_object_t * objs;
+    char * fname;
+    int i, j, n;
     if (!argc) {
         /* FIXME all .stl files in cwd */
     } else {
         for (i=0; i<argc; i++) {
-            read_file(argv[i]);
-            scale_file();
-            write_file(argv[i]);
-            free_file();
+            n = ogd_objects(argv[i], &fname, &objs);
+            if (n < 0)
+                exit(1);
+            for (j=0; j<n; j++) {
+                read_file(fname, &objs[j]);
+                scale_file();
+                write_file(fname, &objs[j]);
+                free_file();
+            }
+            free(objs);
+            free(fname);
         }
     }
 }
@@ -0,0 +1,237 @@
+/*
+ * stl_normals.c - face normals for STL triangles
+ *
+ * the cross product kernels work on a structure of arrays, 4 or 8
+ * triangles at a time. packed STL records are gathered into blocks
+ * of that layout, and large files are split among threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "stl_normals.h"
+
+#define BLOCK 1024 /* triangles gathered at a time */
+
+/**************************************************************/
+/* kernels                                                    */
+
+typedef void (*normals_fn)(const struct stl_soa_t * t, size_t i, size_t end);
+
+void normals_scalar(const struct stl_soa_t * t, size_t i, size_t end)
+{
+    float * const * v = t->v;
+
+    for (; i<end; i++) {
+        float ux = v[3][i] - v[0][i];
+        float uy = v[4][i] - v[1][i];
+        float uz = v[5][i] - v[2][i];
+        float wx = v[6][i] - v[0][i];
+        float wy = v[7][i] - v[1][i];
+        float wz = v[8][i] - v[2][i];
+        float nx = uy * wz - uz * wy;
+        float ny = uz * wx - ux * wz;
+        float nz = ux * wy - uy * wx;
+        float len = sqrtf(nx * nx + ny * ny + nz * nz);
+        float inv = len > 0.0f ? 1.0f / len : 0.0f;
+        t->n[0][i] = nx * inv;
+        t->n[1][i] = ny * inv;
+        t->n[2][i] = nz * inv;
+    }
+}
+
+/* the vector kernels compute exactly what the scalar one does */
+#ifdef __SSE__
+void normals_sse(const struct stl_soa_t * t, size_t i, size_t end)
+{
+    float * const * v = t->v;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one  = _mm_set1_ps(1.0f);
+
+    for (; i+4<=end; i+=4) {
+        __m128 ax = _mm_loadu_ps(v[0] + i);
+        __m128 ay = _mm_loadu_ps(v[1] + i);
+        __m128 az = _mm_loadu_ps(v[2] + i);
+        __m128 ux = _mm_sub_ps(_mm_loadu_ps(v[3] + i), ax);
+        __m128 uy = _mm_sub_ps(_mm_loadu_ps(v[4] + i), ay);
+        __m128 uz = _mm_sub_ps(_mm_loadu_ps(v[5] + i), az);
+        __m128 wx = _mm_sub_ps(_mm_loadu_ps(v[6] + i), ax);
+        __m128 wy = _mm_sub_ps(_mm_loadu_ps(v[7] + i), ay);
+        __m128 wz = _mm_sub_ps(_mm_loadu_ps(v[8] + i), az);
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(uy, wz), _mm_mul_ps(uz, wy));
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(uz, wx), _mm_mul_ps(ux, wz));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(ux, wy), _mm_mul_ps(uy, wx));
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                        _mm_mul_ps(nz, nz)));
+        __m128 inv = _mm_and_ps(_mm_cmpgt_ps(len, zero),
+                _mm_div_ps(one, len));
+        _mm_storeu_ps(t->n[0] + i, _mm_mul_ps(nx, inv));
+        _mm_storeu_ps(t->n[1] + i, _mm_mul_ps(ny, inv));
+        _mm_storeu_ps(t->n[2] + i, _mm_mul_ps(nz, inv));
+    }
+    normals_scalar(t, i, end);
+}
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx")))
+void normals_avx(const struct stl_soa_t * t, size_t i, size_t end)
+{
+    float * const * v = t->v;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one  = _mm256_set1_ps(1.0f);
+
+    for (; i+8<=end; i+=8) {
+        __m256 ax = _mm256_loadu_ps(v[0] + i);
+        __m256 ay = _mm256_loadu_ps(v[1] + i);
+        __m256 az = _mm256_loadu_ps(v[2] + i);
+        __m256 ux = _mm256_sub_ps(_mm256_loadu_ps(v[3] + i), ax);
+        __m256 uy = _mm256_sub_ps(_mm256_loadu_ps(v[4] + i), ay);
+        __m256 uz = _mm256_sub_ps(_mm256_loadu_ps(v[5] + i), az);
+        __m256 wx = _mm256_sub_ps(_mm256_loadu_ps(v[6] + i), ax);
+        __m256 wy = _mm256_sub_ps(_mm256_loadu_ps(v[7] + i), ay);
+        __m256 wz = _mm256_sub_ps(_mm256_loadu_ps(v[8] + i), az);
+        __m256 nx = _mm256_sub_ps(_mm256_mul_ps(uy, wz), _mm256_mul_ps(uz, wy));
+        __m256 ny = _mm256_sub_ps(_mm256_mul_ps(uz, wx), _mm256_mul_ps(ux, wz));
+        __m256 nz = _mm256_sub_ps(_mm256_mul_ps(ux, wy), _mm256_mul_ps(uy, wx));
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+                        _mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)),
+                        _mm256_mul_ps(nz, nz)));
+        __m256 inv = _mm256_and_ps(_mm256_cmp_ps(len, zero, _CMP_GT_OQ),
+                _mm256_div_ps(one, len));
+        _mm256_storeu_ps(t->n[0] + i, _mm256_mul_ps(nx, inv));
+        _mm256_storeu_ps(t->n[1] + i, _mm256_mul_ps(ny, inv));
+        _mm256_storeu_ps(t->n[2] + i, _mm256_mul_ps(nz, inv));
+    }
+    normals_scalar(t, i, end);
+}
+#endif
+
+static normals_fn   normals      = NULL;
+static const char * normals_name = NULL;
+
+static void normals_init(void)
+{
+    normals      = normals_scalar;
+    normals_name = "scalar";
+#ifdef __SSE__
+    normals      = normals_sse;
+    normals_name = "sse";
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        normals      = normals_avx;
+        normals_name = "avx";
+    }
+#endif
+}
+
+static pthread_once_t normals_once = PTHREAD_ONCE_INIT;
+
+const char * stl_normals_kernel(void)
+{
+    pthread_once(&normals_once, normals_init);
+    return normals_name;
+}
+
+void stl_soa_normals(const struct stl_soa_t * t, size_t first, size_t count)
+{
+    pthread_once(&normals_once, normals_init);
+    normals(t, first, first + count);
+}
+
+/**************************************************************/
+/* packed STL records                                         */
+
+/* gather a block into SoA, compute, scatter the normals back */
+static void records_normals(char * r, size_t n)
+{
+    float soa[12][BLOCK];
+    struct stl_soa_t t;
+    size_t i, k;
+
+    for (k=0; k<9; k++)
+        t.v[k] = soa[k];
+    for (k=0; k<3; k++)
+        t.n[k] = soa[9 + k];
+
+    while (n) {
+        size_t len = n < BLOCK ? n : BLOCK;
+        for (i=0; i<len; i++)
+            for (k=0; k<9; k++)
+                memcpy(&soa[k][i], r + i * STL_RECORD_SIZE + 12 + 4 * k, 4);
+        normals(&t, 0, len);
+        for (i=0; i<len; i++)
+            for (k=0; k<3; k++)
+                memcpy(r + i * STL_RECORD_SIZE + 4 * k, &soa[9 + k][i], 4);
+        r += len * STL_RECORD_SIZE;
+        n -= len;
+    }
+}
+
+struct normals_job_t {
+    char   * r;
+    size_t   n;
+};
+
+static void * normals_thread(void * arg)
+{
+    struct normals_job_t * j = arg;
+    records_normals(j->r, j->n);
+    return NULL;
+}
+
+#define MAX_THREADS 64
+
+void stl_face_normals(void * records, size_t n, int nthreads)
+{
+    pthread_t            tid[MAX_THREADS];
+    struct normals_job_t job[MAX_THREADS];
+    size_t per;
+    int i, started = 0;
+
+    pthread_once(&normals_once, normals_init);
+
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+    /* threads don't pay off for small files */
+    if (nthreads < 2 || n < 16 * BLOCK) {
+        records_normals(records, n);
+        return;
+    }
+
+    per = (n + nthreads - 1) / nthreads;
+    for (i=0; i<nthreads; i++) {
+        size_t first = i * per;
+        job[i].r = (char *) records + first * STL_RECORD_SIZE;
+        job[i].n = first >= n ? 0 : (n - first < per ? n - first : per);
+    }
+    /* the calling thread takes the first share */
+    for (i=1; i<nthreads; i++) {
+        if (pthread_create(&tid[i], NULL, normals_thread, &job[i])) {
+            printf("!!! couldn't start normals thread, going on without\n");
+            break;
+        }
+        started++;
+    }
+    records_normals(job[0].r, job[0].n);
+    for (i=1; i<=started; i++)
+        pthread_join(tid[i], NULL);
+    /* jobs of threads that didn't start */
+    for (i=started+1; i<nthreads; i++)
+        records_normals(job[i].r, job[i].n);
+}
@@ -0,0 +1,36 @@
+/*
+ * stl_normals.h - face normals for STL triangles
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#ifndef STL_NORMALS_H
+#define STL_NORMALS_H
+
+#include <stddef.h>
+
+#define STL_RECORD_SIZE 50 /* normal, 3 vertices, 2 attribute bytes */
+
+/* triangles as structure of arrays: v[0..2] are x,y,z of the */
+/* 1st vertex, v[3..5] of the 2nd and v[6..8] of the 3rd one. */
+/* n[0..2] receive x,y,z of the unit normals.                 */
+struct stl_soa_t {
+    float * v[9];
+    float * n[3];
+};
+
+/* normals of the triangles [first, first+count) of t, the */
+/* vertices in counter-clockwise order. degenerate ones get 0. */
+void stl_soa_normals(const struct stl_soa_t * t, size_t first, size_t count);
+
+/* recomputes the normals of n packed 50 byte STL records in place, */
+/* using up to nthreads threads                                      */
+void stl_face_normals(void * records, size_t n, int nthreads);
+
+/* name of the kernel picked for this cpu, "scalar", "sse" or "avx" */
+const char * stl_normals_kernel(void);
+
+#endif
@@ -19,6 +19,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "stl_normals.h"
+#include "ogd.h"
+
 #define OUT_FNAME "out.stl"
 
 char stl_header[80] =
@@ -36,6 +39,7 @@ int opt_scale = 0;
 int opt_x_off = 0;
 int opt_y_off = 0;
 int opt_z_off = 0;
+int opt_normals = 0;
 
 double scale = 1.0;
 int x_off = 0;
@@ -44,19 +48,20 @@ int z_off = 0;
 int file_count = 0;
 
 
-void read_file(char * fname)
+void read_file(char * fname, struct ogd_object_t * o)
 {
     int ret;
-    f = fopen(fname, "rw");
+    f = fopen(fname, "r");
     if (!f) {
         printf("!!! couldn't fopen(%s): %s\n",
                 fname,
                 strerror(errno));
         exit(1);
     }
-    ret = fseek(f, 80, SEEK_SET);
+    ret = fseeko(f, o->offset + 80, SEEK_SET);
     if (ret) {
-        printf("!!! couldn't wind 80 bytes into %s: %s\n",
+        printf("!!! couldn't wind %llu bytes into %s: %s\n",
+                (unsigned long long) o->offset + 80,
                 fname,
                 strerror(errno));
         exit(1);
@@ -67,7 +72,8 @@ void read_file(char * fname)
                 strerror(errno));
         exit(1);
     }
-    printf("+++ %s has %d triangles\n", fname, n_file);
+    printf("+++ %s%s%s has %d triangles\n", fname,
+            o->name[0] ? ":" : "", o->name, n_file);
     t_file = malloc(n_file * 50);
     if (!t_file) {
         printf("!!! couldn't malloc %d bytes: %s\n",
@@ -173,6 +179,13 @@ void write_file(void)
         }
     }
 
+    if (opt_normals) {
+        int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        printf("+++ recomputing normals, %s kernel, %d threads\n",
+                stl_normals_kernel(), nthreads);
+        stl_face_normals(t_tot, n_tot, nthreads);
+    }
+
     printf("+++ writing STL file %s with %d triangles\n",
             OUT_FNAME, n_tot);
     f = fopen(OUT_FNAME, "w");
@@ -208,25 +221,37 @@ void usage(void)
     printf("              the input file(s) won't be modified,\n");
     printf("              all is written to %s\n\n", OUT_FNAME);
     printf("usage: stl_process [options] inputfile(s)\n");
+    printf("       an ogldump container (.ogd) adds all its objects,\n");
+    printf("       file.ogd:name just the one\n");
     printf("options:\n");
     printf("\t-s factor : scale output by factor\n");
     printf("\t-x x_off  : when merging, add x_off per input file in the output\n");
     printf("\t-y y_off  : when merging, add y_off per input file in the output\n");
     printf("\t-z z_off  : when merging, add z_off per input file in the output\n");
+    printf("\t-n        : recompute all normals from the vertices\n");
     printf("\t-h        : show this help\n");
 
 }
 
 void stl_process(int argc, char ** argv)
 {
-    int i;
+    struct ogd_object_t * objs;
+    char * fname;
+    int i, j, n;
     if (!argc) {
         /* FIXME all .stl files in cwd */
     } else {
         for (i=0; i<argc; i++) {
-            read_file(argv[i]);
-            append_file();
-            free_file();
+            n = ogd_objects(argv[i], &fname, &objs);
+            if (n < 0)
+                exit(1);
+            for (j=0; j<n; j++) {
+                read_file(fname, &objs[j]);
+                append_file();
+                free_file();
+            }
+            free(objs);
+            free(fname);
         }
         write_file();
     }
@@ -237,7 +262,7 @@ int main(int argc, char ** argv)
     char optchar;
     char * endptr;
 
-    while ((optchar = getopt (argc, argv, "s:x:y:z:h")) != -1)
+    while ((optchar = getopt (argc, argv, "s:x:y:z:nh")) != -1)
     {
         switch (optchar) {
             case 's':
@@ -275,6 +300,9 @@ int main(int argc, char ** argv)
                 }
                 printf("+++ using z offset %d\n", z_off);
                 break;
+            case 'n':
+                opt_normals = 1;
+                break;
             case 'h':
                 usage();
                 exit(0);